@@ -0,0 +1,349 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description: performance regression harness. Runs a fixed corpus of instances through every
+ * solver mode, records wall time, memoized states, peak memory and the optimality gap against the
+ * exact recursion into a json file, and compares them with a committed baseline.
+ *
+ * usage: CashMultiBench [--output file] [--baseline file] [--time-tolerance x]
+ *                       [--gap-tolerance x] [--min-time seconds] [--instance name]
+ * the process exits with 1 when a time or a gap regresses beyond its tolerance.
+ *
+ */
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include "sharded_solver.h"
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "parallel_recursion.h"
+#include "pmf.h"
+#include "state_multi.h"
+#include "stationary_solver.h"
+#include "two_product.h"
+
+struct Instance {
+    std::string name;
+    int T;
+    int capacity;
+    double interest_rate;
+    std::vector<double> prices;
+    std::vector<double> unit_order_costs;
+    std::vector<double> unit_salvage_values;
+    std::array<double, 2> mean_demands;
+    std::array<double, 2> scales;
+    double ini_cash;
+};
+
+struct Record {
+    std::string instance;
+    std::string mode;
+    double time{};
+    std::size_t states{};
+    long peak_memory_kb{};
+    double value{};
+    double gap{};
+};
+
+// the result a solver mode passes back to the harness
+struct ModeResult {
+    double value;
+    double time;
+    std::size_t states;
+};
+
+constexpr double truncated_quantile = 0.999;
+constexpr double max_I = 100;
+
+const std::vector<Instance> corpus = {
+        {"base_T3_c20", 3, 20, 0.0, {1.2, 2.0}, {1.0, 1.5}, {0.5, 0.75}, {10.0, 5.0},
+         {1 / 2.5, 1 / 1.25}, 10},
+        {"main_T4_c30", 4, 30, 0.0, {1.2, 2.0}, {1.0, 1.5}, {0.5, 0.75}, {10.0, 5.0},
+         {1 / 2.5, 1 / 1.25}, 10},
+        {"interest_T3_c20", 3, 20, 0.01, {1.2, 2.0}, {1.0, 1.5}, {0.5, 0.75}, {10.0, 5.0},
+         {1 / 2.5, 1 / 1.25}, 10},
+        {"margin_T3_c20", 3, 20, 0.0, {2.0, 3.0}, {1.0, 1.5}, {0.5, 0.75}, {10.0, 5.0},
+         {1 / 2.5, 1 / 1.25}, 20},
+        {"low_demand_T4_c15", 4, 15, 0.0, {1.5, 2.0}, {1.0, 1.2}, {0.5, 0.6}, {4.0, 3.0},
+         {1 / 2.5, 1 / 1.25}, 8},
+        {"high_demand_T2_c35", 2, 35, 0.0, {1.4, 1.8}, {1.0, 1.5}, {0.4, 0.75}, {15.0, 8.0},
+         {1 / 2.5, 1 / 1.25}, 30},
+        {"long_T8_c6", 8, 6, 0.0, {2.0, 3.0}, {1.0, 1.5}, {0.5, 0.75}, {1.5, 1.0},
+         {1 / 2.5, 1 / 1.25}, 8},
+};
+
+const std::vector<std::string> modes = {"recursion",  "recursion_fixed", "recursion_compact",
+                                        "recursion2", "heuristic1",      "heuristic1_2",
+                                        "heuristic2", "query_policy", "reduced_8",
+                                        "reduced_32", "reduced_128", "recursion_parallel",
+                                        "stationary"
+#ifdef __linux__
+                                        ,
+                                        "recursion_sharded"
+#endif
+};
+
+constexpr int fixed_cash_scale = 100; // cents for the recursion_fixed mode
+constexpr double query_time_budget = 0.01; // seconds for the query_policy mode
+constexpr int num_shards = 4; // worker processes for the recursion_sharded mode
+constexpr int num_parallel_threads = 4; // threads for the recursion_parallel mode
+// the stationary mode only runs on long horizons, where a stationary policy should be near optimal
+constexpr int stationary_min_T = 8;
+constexpr double stationary_cash_step = 0.5;
+constexpr int stationary_cash_buckets = 40;
+constexpr double stationary_discount = 0.99; // used when the interest rate is 0
+
+/**
+ * solve one instance with one mode on a fresh problem, so modes do not share caches
+ * @param instance
+ * @param mode
+ * @return value, wall time and number of memoized states
+ */
+ModeResult run_mode(const Instance &instance, const std::string &mode) {
+    const auto pmf =
+            get_pmf_gamma2_product(instance.mean_demands, instance.scales, truncated_quantile);
+    const auto ini_state = StateMulti(1, 0, 0, instance.ini_cash);
+    auto problem = TwoProduct(instance.T, instance.capacity, max_I, instance.interest_rate,
+                              instance.prices, instance.unit_order_costs,
+                              instance.unit_salvage_values, pmf);
+
+    const auto start_time = std::chrono::high_resolution_clock::now();
+    double value = 0.0;
+    std::size_t states = 0;
+    std::chrono::duration<double> excluded_time{0}; // evaluation that is not part of the mode
+    if (mode == "recursion" or mode == "recursion_fixed" or mode == "recursion_compact") {
+        if (mode == "recursion_fixed")
+            problem.set_cash_scale(fixed_cash_scale);
+        if (mode == "recursion_compact")
+            problem.set_compact_memo(true, true);
+        value = problem.solve(ini_state)[0];
+        states = problem.num_states_recursion();
+    } else if (mode == "recursion_parallel") {
+        auto solver = ParallelRecursion(problem, num_parallel_threads);
+        value = solver.solve(ini_state)[0];
+        states = solver.num_states();
+    }
+#ifdef __linux__
+    else if (mode == "recursion_sharded") {
+        auto solver = ShardedSolver(problem, num_shards);
+        value = solver.solve(ini_state)[0];
+        states = solver.num_states();
+    }
+#endif
+    else if (mode == "stationary") {
+        // value the stationary policy over the finite horizon, so its gap is against recursion
+        const auto policy =
+                StationarySolver(problem, stationary_cash_step, stationary_cash_buckets,
+                                 instance.interest_rate > 0 ? 0.0 : stationary_discount)
+                        .solve(1e-6, 1000);
+        value = problem.evaluate_policy(
+                ini_state, [&policy](const StateMulti &state) { return policy.action(state); });
+        states = policy.values.size();
+    } else if (mode.starts_with("reduced_")) {
+        // solve with K demand points, then value that policy under the full pmf
+        auto reduced = problem;
+        reduced.set_pmf(reduce_pmf_kmeans(pmf, std::stoi(mode.substr(8))));
+        value = problem.evaluate_policy(ini_state, reduced);
+        states = reduced.num_states_recursion();
+    } else if (mode == "heuristic2") {
+        value = problem.heuristic2(ini_state) + ini_state.get_ini_cash();
+    } else {
+        problem.set_pmfs(instance.mean_demands, instance.scales, truncated_quantile);
+        problem.get_a_stars();
+        if (mode == "recursion2") {
+            value = problem.recursion2(ini_state) + ini_state.get_ini_cash();
+            states = problem.num_states_recursion2();
+        } else if (mode == "heuristic1") {
+            value = problem.heuristic1(ini_state);
+        } else if (mode == "query_policy") {
+            const auto query = problem.query_policy(ini_state, query_time_budget, instance.T);
+            states = problem.num_states_lookahead();
+            // the row times the query only; its order is valued with the optimal continuation,
+            // not by the estimate of the lookahead, so that its gap is against recursion
+            const auto evaluation_start = std::chrono::high_resolution_clock::now();
+            value = problem.evaluate_policy(ini_state, [&](const StateMulti &state) {
+                return state == ini_state ? std::array{query.q1, query.q2}
+                                          : problem.policy_action(state);
+            });
+            excluded_time = std::chrono::high_resolution_clock::now() - evaluation_start;
+        } else {
+            value = problem.heuristic1_2(ini_state);
+            states = problem.num_states_heuristic1();
+        }
+    }
+    const auto end_time = std::chrono::high_resolution_clock::now();
+    const std::chrono::duration<double> time = end_time - start_time - excluded_time;
+    return {value, time.count(), states};
+}
+
+/**
+ * run a mode in a child process on Linux so that the peak resident memory belongs to this mode only
+ * @param instance
+ * @param mode
+ * @return
+ */
+Record measure(const Instance &instance, const std::string &mode) {
+    Record record{instance.name, mode};
+#ifdef __linux__
+    int fds[2];
+    if (pipe(fds) == 0) {
+        if (const pid_t pid = fork(); pid == 0) {
+            close(fds[0]);
+            const ModeResult result = run_mode(instance, mode);
+            const bool written = write(fds[1], &result, sizeof(result)) == sizeof(result);
+            close(fds[1]);
+            _exit(written ? 0 : 1);
+        } else if (pid > 0) {
+            close(fds[1]);
+            ModeResult result{};
+            const bool read_ok = read(fds[0], &result, sizeof(result)) == sizeof(result);
+            close(fds[0]);
+            int status = 0;
+            rusage usage{};
+            wait4(pid, &status, 0, &usage);
+            if (!read_ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                throw std::runtime_error("mode " + mode + " failed on " + instance.name);
+            record.value = result.value;
+            record.time = result.time;
+            record.states = result.states;
+            record.peak_memory_kb = usage.ru_maxrss;
+            return record;
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+#endif
+    const ModeResult result = run_mode(instance, mode);
+    record.value = result.value;
+    record.time = result.time;
+    record.states = result.states;
+    return record;
+}
+
+void write_json(const std::string &file_name, const std::vector<Record> &records) {
+    std::ofstream out(file_name);
+    out << std::setprecision(10) << "{\n  \"results\": [\n";
+    for (std::size_t i = 0; i < records.size(); i++) {
+        const auto &r = records[i];
+        out << "    {\"instance\": \"" << r.instance << "\", \"mode\": \"" << r.mode
+            << "\", \"time\": " << r.time << ", \"states\": " << r.states
+            << ", \"peak_memory_kb\": " << r.peak_memory_kb << ", \"value\": " << r.value
+            << ", \"gap\": " << r.gap << "}" << (i + 1 < records.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+/**
+ * compare the records with a baseline file
+ * @return number of regressions
+ */
+int compare_with_baseline(const std::string &file_name, const std::vector<Record> &records,
+                          const double time_tolerance, const double gap_tolerance,
+                          const double min_time) {
+    boost::property_tree::ptree tree;
+    boost::property_tree::read_json(file_name, tree);
+    std::map<std::pair<std::string, std::string>, Record> baseline;
+    for (const auto &[key, node]: tree.get_child("results")) {
+        Record r{node.get<std::string>("instance"), node.get<std::string>("mode")};
+        r.time = node.get<double>("time");
+        r.gap = node.get<double>("gap");
+        baseline[{r.instance, r.mode}] = r;
+    }
+
+    int regressions = 0;
+    for (const auto &r: records) {
+        const auto it = baseline.find({r.instance, r.mode});
+        if (it == baseline.end()) {
+            std::cout << "no baseline for " << r.instance << " " << r.mode << std::endl;
+            continue;
+        }
+        const Record &base = it->second;
+        if (r.time > min_time && r.time > base.time * (1 + time_tolerance)) {
+            std::cout << "TIME REGRESSION " << r.instance << " " << r.mode << ": " << r.time
+                      << "s vs baseline " << base.time << "s" << std::endl;
+            regressions++;
+        }
+        if (std::fabs(r.gap) > std::fabs(base.gap) + gap_tolerance) {
+            std::cout << "GAP REGRESSION " << r.instance << " " << r.mode << ": " << r.gap
+                      << " vs baseline " << base.gap << std::endl;
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[]) {
+    std::string output = "bench_results.json";
+    std::string baseline;
+    std::string only_instance; // run a single instance of the corpus when given
+    double time_tolerance = 0.5; // relative slow down allowed
+    double gap_tolerance = 1e-4; // absolute increase of the relative gap allowed
+    double min_time = 0.05; // times below this are too noisy to compare
+    for (int i = 1; i < argc; i += 2) {
+        const std::string option = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "missing value of option " << option << std::endl;
+            return 2;
+        }
+        if (option == "--output")
+            output = argv[i + 1];
+        else if (option == "--baseline")
+            baseline = argv[i + 1];
+        else if (option == "--time-tolerance")
+            time_tolerance = std::stod(argv[i + 1]);
+        else if (option == "--gap-tolerance")
+            gap_tolerance = std::stod(argv[i + 1]);
+        else if (option == "--min-time")
+            min_time = std::stod(argv[i + 1]);
+        else if (option == "--instance")
+            only_instance = argv[i + 1];
+        else {
+            std::cerr << "unknown option " << option << std::endl;
+            return 2;
+        }
+    }
+
+    std::vector<Record> records;
+    for (const auto &instance: corpus) {
+        if (!only_instance.empty() && instance.name != only_instance)
+            continue;
+        double exact_value = 0.0;
+        for (const auto &mode: modes) {
+            if (mode == "stationary" and instance.T < stationary_min_T)
+                continue;
+            Record record = measure(instance, mode);
+            if (mode == "recursion")
+                exact_value = record.value;
+            record.gap = (record.value - exact_value) / std::fmax(std::fabs(exact_value), 1e-12);
+            std::cout << std::left << std::setw(20) << instance.name << std::setw(20) << mode
+                      << std::right << std::fixed << std::setprecision(6) << std::setw(12)
+                      << record.time << "s" << std::setw(10) << record.states << " states"
+                      << std::setw(10) << record.peak_memory_kb << " KB  value "
+                      << record.value << "  gap " << record.gap << std::endl;
+            records.push_back(record);
+        }
+    }
+    write_json(output, records);
+    std::cout << "results written to " << output << std::endl;
+
+    if (baseline.empty())
+        return 0;
+    const int regressions =
+            compare_with_baseline(baseline, records, time_tolerance, gap_tolerance, min_time);
+    std::cout << regressions << " regression(s) against " << baseline << std::endl;
+    return regressions == 0 ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description:
+ *
+ *
+ */
+
+#include "compact_memo.h"
+#include <cmath>
+
+CompactMemo::CompactMemo() = default;
+
+CompactMemo::CompactMemo(const bool delta_encoded) : delta_encoded(delta_encoded) {}
+
+double CompactMemo::decode(const int period, const float value) const {
+    return delta_encoded ? period_bases[period] + value : value;
+}
+
+/**
+ * store the value and action of a state
+ * @param state
+ * @param value
+ * @param action
+ * @return the value as later lookups decode it, so that the caller and the lookups agree
+ */
+double CompactMemo::insert(const StateMulti &state, const double value,
+                           const std::array<double, 2> &action) {
+    const int period = state.get_period();
+    if (delta_encoded) {
+        if (period >= static_cast<int>(period_bases.size())) {
+            period_bases.resize(period + 1);
+            has_base.resize(period + 1);
+        }
+        if (!has_base[period]) {
+            period_bases[period] = value;
+            has_base[period] = true;
+        }
+    }
+    const auto stored =
+            static_cast<float>(delta_encoded ? value - period_bases[period] : value);
+    const double decoded = decode(period, stored);
+    max_error = std::fmax(max_error, std::fabs(decoded - value));
+    entries[state] = Entry{stored, static_cast<std::uint16_t>(action[0]),
+                           static_cast<std::uint16_t>(action[1])};
+    return decoded;
+}
+
+bool CompactMemo::find(const StateMulti &state, double &value) const {
+    const auto it = entries.find(state);
+    if (it == entries.end())
+        return false;
+    value = decode(state.get_period(), it->second.value);
+    return true;
+}
+
+std::array<double, 2> CompactMemo::get_action(const StateMulti &state) const {
+    const Entry &entry = entries.at(state);
+    return {static_cast<double>(entry.q1), static_cast<double>(entry.q2)};
+}
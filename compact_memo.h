@@ -0,0 +1,53 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description: compact memo for the exact recursion: one float value and two 16-bit order
+ * quantities per state, optionally stored as float deltas from a per-period base value.
+ *
+ *
+ */
+
+#ifndef COMPACT_MEMO_H
+#define COMPACT_MEMO_H
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "state_multi.h"
+
+class CompactMemo {
+public:
+    struct Entry {
+        float value;
+        std::uint16_t q1;
+        std::uint16_t q2;
+    };
+
+private:
+    std::unordered_map<StateMulti, Entry> entries;
+    bool delta_encoded{};
+    std::vector<double> period_bases; // the first value stored in each period
+    std::vector<bool> has_base;
+    // largest rounding error of a single stored value; errors of the next states add up in the
+    // value of a state, so the final value can be off by more, compare with an exact run for that
+    double max_error{};
+
+    [[nodiscard]] double decode(int period, float value) const;
+
+public:
+    CompactMemo();
+    explicit CompactMemo(bool delta_encoded);
+
+    double insert(const StateMulti &state, double value, const std::array<double, 2> &action);
+    [[nodiscard]] bool find(const StateMulti &state, double &value) const;
+    [[nodiscard]] std::array<double, 2> get_action(const StateMulti &state) const;
+
+    [[nodiscard]] std::size_t size() const { return entries.size(); }
+    [[nodiscard]] double get_max_error() const { return max_error; }
+    [[nodiscard]] bool is_delta_encoded() const { return delta_encoded; }
+};
+
+
+#endif // COMPACT_MEMO_H
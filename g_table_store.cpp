@@ -0,0 +1,136 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description:
+ *
+ *
+ */
+
+#include "g_table_store.h"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace {
+    constexpr std::uint64_t magic = 0x3142415447687361ULL;
+    constexpr std::uint32_t format_version = 2; // changes whenever the file layout changes
+
+    // file layout: header, pmf[num_demands][2], a*[T + 1], G[T + 1][capacity]
+    struct Header {
+        std::uint64_t magic;
+        std::uint32_t format_version;
+        std::uint32_t algorithm_version;
+        std::uint64_t fingerprint;
+        std::int32_t T;
+        std::int32_t capacity;
+        double interest_rate;
+        double price;
+        double unit_order_cost;
+        double unit_salvage_value;
+        std::uint64_t num_demands;
+    };
+    static_assert(sizeof(Header) == 72, "the header has no padding, so it compares bytewise");
+
+    Header make_header(const GTableKey &key) {
+        return {magic,
+                format_version,
+                key.algorithm_version,
+                key.fingerprint(),
+                key.T,
+                key.capacity,
+                key.interest_rate,
+                key.price,
+                key.unit_order_cost,
+                key.unit_salvage_value,
+                key.pmf.size()};
+    }
+
+    std::size_t file_size(const GTableKey &key) {
+        return sizeof(Header) + sizeof(double) * 2 * key.pmf.size() +
+               sizeof(std::int32_t) * (key.T + 1) + sizeof(double) * key.capacity * (key.T + 1);
+    }
+} // namespace
+
+GTableStore::GTableStore(std::string directory) : directory(std::move(directory)) {
+    std::filesystem::create_directories(this->directory);
+}
+
+std::string GTableStore::path(const std::uint64_t fingerprint) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "g_%016llx.bin",
+                  static_cast<unsigned long long>(fingerprint));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+/**
+ * read the a* levels and G table of a key into the vectors
+ * @return false when the store has no table whose versions and parameters all equal the key
+ */
+bool GTableStore::load(const GTableKey &key, std::vector<int> &a_stars,
+                       std::vector<std::vector<double>> &values) const {
+    const Header expected = make_header(key);
+    const std::string file_name = path(expected.fingerprint);
+    if (!std::filesystem::exists(file_name))
+        return false;
+    const std::size_t pmf_bytes = sizeof(double) * 2 * key.pmf.size();
+    const std::size_t a_star_bytes = sizeof(std::int32_t) * (key.T + 1);
+    const std::size_t row_bytes = sizeof(double) * key.capacity;
+    try {
+        const boost::interprocess::file_mapping file(file_name.c_str(),
+                                                     boost::interprocess::read_only);
+        const boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+        const auto *data = static_cast<const char *>(region.get_address());
+        if (region.get_size() != file_size(key) ||
+            std::memcmp(data, &expected, sizeof(Header)) != 0 ||
+            std::memcmp(data + sizeof(Header), key.pmf.data(), pmf_bytes) != 0)
+            return false;
+
+        const char *tables = data + sizeof(Header) + pmf_bytes;
+        std::vector<std::int32_t> stored_a_stars(key.T + 1);
+        std::memcpy(stored_a_stars.data(), tables, a_star_bytes);
+        a_stars.assign(stored_a_stars.begin(), stored_a_stars.end());
+        values.resize(key.T + 1);
+        for (int t = 0; t <= key.T; t++) {
+            values[t].resize(key.capacity);
+            std::memcpy(values[t].data(), tables + a_star_bytes + row_bytes * t, row_bytes);
+        }
+    } catch (const boost::interprocess::interprocess_exception &) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * write the a* levels and G table of a key; the file is renamed into place once complete, so
+ * concurrent readers never see a partial table
+ */
+void GTableStore::save(const GTableKey &key, const std::vector<int> &a_stars,
+                       const std::vector<std::vector<double>> &values) const {
+    const Header header = make_header(key);
+    const std::vector<std::int32_t> stored_a_stars(a_stars.begin(), a_stars.end());
+
+    const std::string file_name = path(header.fingerprint);
+    const std::string temp_name = file_name + ".tmp" + std::to_string(std::random_device{}());
+    {
+        std::ofstream out(temp_name, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+        out.write(reinterpret_cast<const char *>(key.pmf.data()),
+                  static_cast<std::streamsize>(sizeof(double) * 2 * key.pmf.size()));
+        out.write(reinterpret_cast<const char *>(stored_a_stars.data()),
+                  static_cast<std::streamsize>(sizeof(std::int32_t) * stored_a_stars.size()));
+        for (const auto &row: values)
+            out.write(reinterpret_cast<const char *>(row.data()),
+                      static_cast<std::streamsize>(sizeof(double) * row.size()));
+    }
+    std::error_code error;
+    if (std::ifstream(temp_name, std::ios::binary | std::ios::ate).tellg() ==
+        static_cast<std::streamoff>(file_size(key)))
+        std::filesystem::rename(temp_name, file_name, error);
+    else
+        std::filesystem::remove(temp_name, error);
+    if (error)
+        std::filesystem::remove(temp_name, error);
+}
@@ -0,0 +1,79 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description: persistent library of G tables and a* levels of single products, one
+ * memory-mapped file per parameter fingerprint, so that products sharing price, cost, salvage
+ * value, demand, horizon and capacity compute their base-stock levels only once.
+ *
+ *
+ */
+
+#ifndef G_TABLE_STORE_H
+#define G_TABLE_STORE_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// FNV-1a hash over the bytes of the parameters of a G table
+class Fingerprint {
+    std::uint64_t hash = 14695981039346656037ULL;
+
+public:
+    template<typename T>
+    void add(const T &value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (const unsigned char byte: bytes) {
+            hash ^= byte;
+            hash *= 1099511628211ULL;
+        }
+    }
+    [[nodiscard]] std::uint64_t get() const { return hash; }
+};
+
+// everything the G table of one product depends on; a stored table is used only when all of it,
+// not just the fingerprint, matches
+struct GTableKey {
+    std::uint32_t algorithm_version; // changes whenever the computation of G or a* changes
+    std::int32_t T;
+    std::int32_t capacity;
+    double interest_rate;
+    double price;
+    double unit_order_cost;
+    double unit_salvage_value;
+    std::vector<std::array<double, 2>> pmf;
+
+    [[nodiscard]] std::uint64_t fingerprint() const {
+        Fingerprint fingerprint;
+        fingerprint.add(algorithm_version);
+        fingerprint.add(T);
+        fingerprint.add(capacity);
+        fingerprint.add(interest_rate);
+        fingerprint.add(price);
+        fingerprint.add(unit_order_cost);
+        fingerprint.add(unit_salvage_value);
+        for (const auto &demand_and_prob: pmf)
+            fingerprint.add(demand_and_prob);
+        return fingerprint.get();
+    }
+};
+
+class GTableStore {
+    std::string directory;
+
+    [[nodiscard]] std::string path(std::uint64_t fingerprint) const;
+
+public:
+    explicit GTableStore(std::string directory);
+
+    bool load(const GTableKey &key, std::vector<int> &a_stars,
+              std::vector<std::vector<double>> &values) const;
+    void save(const GTableKey &key, const std::vector<int> &a_stars,
+              const std::vector<std::vector<double>> &values) const;
+};
+
+
+#endif // G_TABLE_STORE_H
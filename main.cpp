@@ -24,6 +24,7 @@
 
 #include <boost/math/distributions/gamma.hpp>
 #include <chrono>
+#include <filesystem>
 #include <iostream>
 #include <vector>
 
@@ -53,6 +54,9 @@ int main() {
 
     auto problem = TwoProduct(T, capacity, max_I, interest_rate, prices, unit_order_costs,
                               unit_salvage_values, pmf);
+    // the sections below all need a*, which is computed once and then read from the store
+    problem.set_g_table_store(
+            (std::filesystem::temp_directory_path() / "cash_multi_g_tables").string());
 
     const auto start_time = std::chrono::high_resolution_clock::now();
     const auto result = problem.solve(ini_state);
@@ -117,5 +121,14 @@ int main() {
     std::cout << "cash balance using heuristic2 is " << std::fixed << std::setprecision(6) << value5
               << std::endl;
 
+    std::cout << std::string(50, '_') << std::endl;
+    const auto start_time6 = std::chrono::high_resolution_clock::now();
+    const auto query = problem.query_policy(ini_state, 0.01, T);
+    const auto end_time6 = std::chrono::high_resolution_clock::now();
+    const std::chrono::duration<double> time6 = end_time6 - start_time6;
+    std::cout << "running time is " << time6 << std::endl;
+    std::cout << "order quantities from a " << query.depth << "-period lookahead are " << query.q1
+              << " and " << query.q2 << ", estimated cash balance is " << query.value << std::endl;
+
     return 0;
 }
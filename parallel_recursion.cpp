@@ -0,0 +1,154 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description:
+ *
+ *
+ */
+
+#include "parallel_recursion.h"
+#include <limits>
+#include <thread>
+
+ConcurrentMemo::Shard &ConcurrentMemo::shard_of(const StateMulti &state) {
+    return shards[(std::hash<StateMulti>{}(state) >> 16) % num_shards];
+}
+
+/**
+ * find the entry of a state, inserting an in-flight one when it is new
+ * @param state
+ * @return the entry and whether the caller inserted it and has to compute it
+ */
+std::pair<ConcurrentMemo::Entry *, bool> ConcurrentMemo::claim(const StateMulti &state) {
+    Shard &shard = shard_of(state);
+    std::lock_guard lock(shard.mutex);
+    auto [it, inserted] = shard.entries.try_emplace(state);
+    return {&it->second, inserted};
+}
+
+std::size_t ConcurrentMemo::size() {
+    std::size_t states = 0;
+    for (auto &shard: shards) {
+        std::lock_guard lock(shard.mutex);
+        states += shard.entries.size();
+    }
+    return states;
+}
+
+ParallelRecursion::ParallelRecursion(const TwoProduct &problem, const int num_threads) :
+    problem(problem),
+    num_threads(num_threads > 0
+                        ? num_threads
+                        : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))),
+    queues(this->num_threads) {}
+
+/**
+ * take a task of a period after min_period: the newest one of the worker's own queue, or the
+ * oldest or newest one of another queue. Waiting tasks only help with later periods, so every
+ * task a thread runs on top of a waiting one is later than it and the waits cannot form a cycle.
+ */
+bool ParallelRecursion::find_task(const int worker, const int min_period, StateMulti &task) {
+    for (int i = 0; i < num_threads; i++) {
+        WorkerQueue &queue = queues[(worker + i) % num_threads];
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (i > 0 && queue.tasks.front().get_period() > min_period) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            return true;
+        }
+        if (queue.tasks.back().get_period() > min_period) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * compute a claimed state: claim its next states, queue the new ones, help until all of them are
+ * done and then take the best action like TwoProduct::recursion
+ */
+void ParallelRecursion::run(const int worker, const StateMulti &state) { // NOLINT(*-no-recursion)
+    const int T = problem.get_T();
+    const auto &pmf = problem.get_pmf();
+    const std::vector<std::array<double, 2>> actions = problem.feasible_actions(state);
+
+    std::unordered_map<StateMulti, ConcurrentMemo::Entry *> next_entries;
+    if (state.get_period() < T) {
+        for (const std::array action: actions) {
+            for (const auto demand_and_prob: pmf) {
+                const auto new_state = problem.state_transition(
+                        state, action, {demand_and_prob[0], demand_and_prob[1]});
+                if (next_entries.contains(new_state))
+                    continue;
+                const auto [entry, claimed] = memo.claim(new_state);
+                next_entries[new_state] = entry;
+                if (claimed) {
+                    std::lock_guard lock(queues[worker].mutex);
+                    queues[worker].tasks.push_back(new_state);
+                }
+            }
+        }
+        for (const auto &[new_state, entry]: next_entries) {
+            while (!entry->done.load(std::memory_order_acquire)) {
+                if (StateMulti task; find_task(worker, state.get_period(), task))
+                    run(worker, task);
+                else
+                    std::this_thread::yield();
+            }
+        }
+    }
+
+    double best_value = std::numeric_limits<double>::lowest();
+    std::array<double, 2> best_action{};
+    for (const std::array action: actions) {
+        double this_value = 0;
+        for (const auto demand_and_prob: pmf) {
+            const auto demands = std::array{demand_and_prob[0], demand_and_prob[1]};
+            this_value += demand_and_prob[2] * problem.immediate_value(state, action, demands);
+            if (state.get_period() < T)
+                this_value +=
+                        demand_and_prob[2] *
+                        next_entries.at(problem.state_transition(state, action, demands))->value;
+        }
+        if (this_value > best_value) {
+            best_value = this_value;
+            best_action = action;
+        }
+    }
+    ConcurrentMemo::Entry *entry = memo.claim(state).first;
+    entry->value = best_value;
+    entry->action = best_action;
+    entry->done.store(true, std::memory_order_release);
+}
+
+/**
+ * solve from a state with all threads, like TwoProduct::solve
+ * @param state
+ * @return optimal final cash balance and the optimal order quantities of the state
+ */
+std::vector<double> ParallelRecursion::solve(const StateMulti &state) {
+    const auto [root, claimed] = memo.claim(state);
+    if (claimed)
+        queues[0].tasks.push_back(state);
+
+    const auto work = [&](const int worker) {
+        while (!root->done.load(std::memory_order_acquire)) {
+            if (StateMulti task; find_task(worker, 0, task))
+                run(worker, task);
+            else
+                std::this_thread::yield();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int worker = 1; worker < num_threads; worker++)
+        workers.emplace_back(work, worker);
+    work(0);
+    for (auto &thread: workers)
+        thread.join();
+
+    return {root->value + state.get_ini_cash(), root->action[0], root->action[1]};
+}
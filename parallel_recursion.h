@@ -0,0 +1,70 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description: parallel version of the top-down recursion of TwoProduct. Every state is a task
+ * on a work-stealing pool; tasks share a concurrent memo whose entries are claimed before they
+ * are computed, so no state is computed twice, and a task waiting for a state claimed by another
+ * thread runs other tasks meanwhile.
+ *
+ *
+ */
+
+#ifndef PARALLEL_RECURSION_H
+#define PARALLEL_RECURSION_H
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "state_multi.h"
+#include "two_product.h"
+
+class ConcurrentMemo {
+public:
+    struct Entry {
+        std::atomic<bool> done{false}; // false while the state is in flight
+        double value{};
+        std::array<double, 2> action{};
+    };
+
+private:
+    static constexpr int num_shards = 64;
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<StateMulti, Entry> entries; // nodes never move, so entries stay put
+    };
+    std::array<Shard, num_shards> shards;
+
+    [[nodiscard]] Shard &shard_of(const StateMulti &state);
+
+public:
+    std::pair<Entry *, bool> claim(const StateMulti &state);
+    [[nodiscard]] std::size_t size();
+};
+
+class ParallelRecursion {
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<StateMulti> tasks;
+    };
+
+    const TwoProduct &problem;
+    int num_threads;
+    ConcurrentMemo memo;
+    std::vector<WorkerQueue> queues;
+
+    bool find_task(int worker, int min_period, StateMulti &task);
+    void run(int worker, const StateMulti &state);
+
+public:
+    explicit ParallelRecursion(const TwoProduct &problem, int num_threads = 0);
+
+    std::vector<double> solve(const StateMulti &state);
+    [[nodiscard]] std::size_t num_states() { return memo.size(); }
+};
+
+
+#endif // PARALLEL_RECURSION_H
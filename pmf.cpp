@@ -8,6 +8,10 @@
 
 #include "pmf.h"
 #include <boost/math/distributions/gamma.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
 
 // shape = demand / scale
 // variance = shape * scale^2 = demand * scale
@@ -79,3 +83,70 @@ get_pmf_gamma1_products(const std::array<double, 2> &means, const std::array<dou
 
     return pmfs;
 }
+
+std::vector<std::array<double, 3>> reduce_pmf_kmeans(const std::vector<std::array<double, 3>> &pmf,
+                                                     const int num_points,
+                                                     const int max_iterations) {
+    const int n = static_cast<int>(pmf.size());
+    if (num_points >= n || num_points < 1)
+        return pmf;
+    const auto distance = [](const std::array<double, 3> &cell,
+                             const std::array<double, 2> &center) {
+        return (cell[0] - center[0]) * (cell[0] - center[0]) +
+               (cell[1] - center[1]) * (cell[1] - center[1]);
+    };
+
+    // farthest-point initialization from the most likely cell, weighted by probability
+    std::vector<std::array<double, 2>> centers;
+    const auto heaviest = std::max_element(
+            pmf.begin(), pmf.end(), [](const auto &a, const auto &b) { return a[2] < b[2]; });
+    centers.push_back({(*heaviest)[0], (*heaviest)[1]});
+    std::vector<double> distances(n, std::numeric_limits<double>::max());
+    while (static_cast<int>(centers.size()) < num_points) {
+        int farthest = 0;
+        for (int i = 0; i < n; i++) {
+            distances[i] = std::fmin(distances[i], distance(pmf[i], centers.back()));
+            if (pmf[i][2] * distances[i] > pmf[farthest][2] * distances[farthest])
+                farthest = i;
+        }
+        centers.push_back({pmf[farthest][0], pmf[farthest][1]});
+    }
+
+    std::vector<int> assignment(n, -1);
+    for (int iteration = 0; iteration < max_iterations; iteration++) {
+        bool changed = false;
+        for (int i = 0; i < n; i++) {
+            int nearest = 0;
+            for (int k = 1; k < num_points; k++) {
+                if (distance(pmf[i], centers[k]) < distance(pmf[i], centers[nearest]))
+                    nearest = k;
+            }
+            changed = changed || assignment[i] != nearest;
+            assignment[i] = nearest;
+        }
+        if (!changed)
+            break;
+        std::vector<std::array<double, 3>> sums(num_points, {0.0, 0.0, 0.0});
+        for (int i = 0; i < n; i++) {
+            sums[assignment[i]][0] += pmf[i][2] * pmf[i][0];
+            sums[assignment[i]][1] += pmf[i][2] * pmf[i][1];
+            sums[assignment[i]][2] += pmf[i][2];
+        }
+        for (int k = 0; k < num_points; k++) {
+            if (sums[k][2] > 0)
+                centers[k] = {sums[k][0] / sums[k][2], sums[k][1] / sums[k][2]};
+        }
+    }
+
+    // rounded centers may coincide, so their probabilities are merged
+    std::map<std::array<double, 2>, double> points;
+    for (int i = 0; i < n; i++) {
+        const auto &center = centers[assignment[i]];
+        points[{std::round(center[0]), std::round(center[1])}] += pmf[i][2];
+    }
+    std::vector<std::array<double, 3>> reduced;
+    reduced.reserve(points.size());
+    for (const auto &[demands, prob]: points)
+        reduced.push_back({demands[0], demands[1], prob});
+    return reduced;
+}
@@ -9,6 +9,7 @@
 #ifndef PMF_H
 #define PMF_H
 
+#include <array>
 #include <vector>
 
 /**
@@ -32,4 +33,16 @@ std::vector<std::array<double, 3>> get_pmf_gamma2_product(const std::array<doubl
 std::array<std::vector<std::array<double, 2>>, 2> get_pmf_gamma1_products(const std::array<double, 2> &means,
                                                   const std::array<double, 2> &scales, double quantile);
 
+/**
+ *  reduce a 2-product pmf to at most num_points weighted demand points by weighted k-means in
+ *  demand space; the points are rounded to whole demands and carry the probability of their
+ *  cluster, so the mean is kept up to the rounding
+ * @param pmf
+ * @param num_points
+ * @param max_iterations of the k-means
+ * @return
+ */
+std::vector<std::array<double, 3>> reduce_pmf_kmeans(const std::vector<std::array<double, 3>> &pmf,
+                                                     int num_points, int max_iterations = 100);
+
 #endif // PMF_H
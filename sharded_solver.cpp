@@ -0,0 +1,345 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description:
+ *
+ *
+ */
+
+#include "sharded_solver.h"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+    static_assert(std::is_trivially_copyable_v<StateMulti>);
+
+    // value and best action of a state as published in the value files
+    struct ValueRecord {
+        StateMulti state;
+        double value;
+        double q1;
+        double q2;
+    };
+
+    /**
+     * write a header and a body into a file through a shared memory map
+     */
+    void publish(const std::string &path, const void *header, const std::size_t header_size,
+                 const void *body, const std::size_t body_size) {
+        const int fd = open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+        if (fd < 0)
+            throw std::runtime_error("cannot create " + path);
+        const std::size_t size = header_size + body_size;
+        if (size == 0) {
+            close(fd);
+            return;
+        }
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            close(fd);
+            throw std::runtime_error("cannot resize " + path);
+        }
+        void *map = mmap(nullptr, size, PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            throw std::runtime_error("cannot map " + path);
+        if (header_size > 0)
+            std::memcpy(map, header, header_size);
+        if (body_size > 0)
+            std::memcpy(static_cast<char *>(map) + header_size, body, body_size);
+        munmap(map, size);
+    }
+
+    // read-only memory map of a file published by a shard
+    class MappedFile {
+        void *data = nullptr;
+        std::size_t size = 0;
+
+    public:
+        explicit MappedFile(const std::string &path) {
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("cannot open " + path);
+            struct stat file_stat {};
+            if (fstat(fd, &file_stat) != 0) {
+                close(fd);
+                throw std::runtime_error("cannot stat " + path);
+            }
+            size = static_cast<std::size_t>(file_stat.st_size);
+            if (size > 0) {
+                data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+                if (data == MAP_FAILED) {
+                    close(fd);
+                    throw std::runtime_error("cannot map " + path);
+                }
+            }
+            close(fd);
+        }
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        MappedFile(MappedFile &&other) noexcept :
+            data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)) {}
+        ~MappedFile() {
+            if (data != nullptr)
+                munmap(data, size);
+        }
+
+        [[nodiscard]] const void *get() const { return data; }
+        template<typename T>
+        [[nodiscard]] const T *begin() const {
+            return static_cast<const T *>(data);
+        }
+        template<typename T>
+        [[nodiscard]] const T *end() const {
+            return begin<T>() + size / sizeof(T);
+        }
+    };
+
+    std::atomic<int> solve_count{0};
+} // namespace
+
+ShardedSolver::ShardedSolver(const TwoProduct &problem, const int num_shards,
+                             const ShardPartition partition, std::string directory) :
+    problem(problem), num_shards(std::max(1, num_shards)), partition(partition),
+    directory(std::move(directory)) {}
+
+/**
+ * owner of a state: by hash, or by ranges of the inventory of product 1 over [0, capacity)
+ * with larger inventories in the last shard
+ */
+int ShardedSolver::shard_of(const StateMulti &state) const {
+    if (partition == ShardPartition::inventory) {
+        const int shard = static_cast<int>(state.get_ini_inventory1()) * num_shards /
+                          problem.get_capacity();
+        return std::clamp(shard, 0, num_shards - 1);
+    }
+    return static_cast<int>(std::hash<StateMulti>{}(state) % num_shards);
+}
+
+std::string ShardedSolver::file_name(const std::string &kind, const int t, const int shard) const {
+    return directory + "/" + prefix + kind + "_" + std::to_string(t) + "_" +
+           std::to_string(shard);
+}
+
+/**
+ * work of one shard process. The forward pass sends every reached state to its owner through
+ * the state files of the next period; the backward pass computes the values of the owned states
+ * and reads next-period values from the value files of all shards. Both passes wait on the
+ * barrier once per period.
+ * @param shard
+ * @param ini_state
+ * @param barrier shared by all shards
+ * @param owned_count shared slot of this shard for the number of states it owned
+ */
+void ShardedSolver::run_shard(const int shard, const StateMulti &ini_state,
+                              pthread_barrier_t *barrier, std::uint64_t *owned_count) const {
+    const int T = problem.get_T();
+    const int first_period = ini_state.get_period();
+    const auto &pmf = problem.get_pmf();
+
+    // own files can be removed once all shards passed the next barrier
+    std::vector<std::string> pending_unlinks;
+    const auto wait = [&] {
+        pthread_barrier_wait(barrier);
+        for (const auto &name: pending_unlinks)
+            unlink(name.c_str());
+        pending_unlinks.clear();
+    };
+
+    std::vector<std::vector<StateMulti>> owned(T + 1);
+    if (shard_of(ini_state) == shard)
+        owned[first_period].push_back(ini_state);
+
+    for (int t = first_period; t < T; t++) {
+        std::vector<std::unordered_set<StateMulti>> reached(num_shards);
+        for (const auto &state: owned[t]) {
+            for (const std::array action: problem.feasible_actions(state)) {
+                for (const auto demand_and_prob: pmf) {
+                    const auto next_state = problem.state_transition(
+                            state, action, {demand_and_prob[0], demand_and_prob[1]});
+                    reached[shard_of(next_state)].insert(next_state);
+                }
+            }
+        }
+        // the state file starts with the number of states sent to each shard
+        std::vector<std::uint64_t> counts(num_shards);
+        std::vector<StateMulti> sent;
+        for (int i = 0; i < num_shards; i++) {
+            counts[i] = reached[i].size();
+            sent.insert(sent.end(), reached[i].begin(), reached[i].end());
+        }
+        const std::string name = file_name("states", t + 1, shard);
+        publish(name, counts.data(), counts.size() * sizeof(std::uint64_t), sent.data(),
+                sent.size() * sizeof(StateMulti));
+        wait();
+        pending_unlinks.push_back(name);
+
+        std::unordered_set<StateMulti> received;
+        for (int i = 0; i < num_shards; i++) {
+            const MappedFile file(file_name("states", t + 1, i));
+            const auto *file_counts = static_cast<const std::uint64_t *>(file.get());
+            const auto *states = reinterpret_cast<const StateMulti *>(file_counts + num_shards);
+            std::uint64_t offset = 0;
+            for (int j = 0; j < shard; j++)
+                offset += file_counts[j];
+            received.insert(states + offset, states + offset + file_counts[shard]);
+        }
+        owned[t + 1].assign(received.begin(), received.end());
+        std::sort(owned[t + 1].begin(), owned[t + 1].end());
+    }
+    *owned_count = 0;
+    for (const auto &states: owned)
+        *owned_count += states.size();
+
+    std::vector<MappedFile> next_tables;
+    const auto next_value = [&](const StateMulti &state) {
+        const MappedFile &table = next_tables[shard_of(state)];
+        const auto *last = table.end<ValueRecord>();
+        const auto *it = std::lower_bound(
+                table.begin<ValueRecord>(), last, state,
+                [](const ValueRecord &record, const StateMulti &s) { return record.state < s; });
+        if (it == last || !(it->state == state))
+            throw std::runtime_error("state missing from the value tables");
+        return it->value;
+    };
+
+    for (int t = T; t >= first_period; t--) {
+        std::vector<ValueRecord> records;
+        records.reserve(owned[t].size());
+        for (const auto &state: owned[t]) {
+            ValueRecord best{state, std::numeric_limits<double>::lowest(), 0.0, 0.0};
+            for (const std::array action: problem.feasible_actions(state)) {
+                double this_value = 0;
+                for (const auto demand_and_prob: pmf) {
+                    const auto demands = std::array{demand_and_prob[0], demand_and_prob[1]};
+                    this_value +=
+                            demand_and_prob[2] * problem.immediate_value(state, action, demands);
+                    if (t < T)
+                        this_value += demand_and_prob[2] *
+                                      next_value(problem.state_transition(state, action, demands));
+                }
+                if (this_value > best.value)
+                    best = {state, this_value, action[0], action[1]};
+            }
+            records.push_back(best);
+        }
+        const std::string name = file_name("values", t, shard);
+        publish(name, nullptr, 0, records.data(), records.size() * sizeof(ValueRecord));
+        wait();
+        // the values of the first period stay for the parent process
+        if (t > first_period) {
+            next_tables.clear();
+            for (int i = 0; i < num_shards; i++)
+                next_tables.emplace_back(file_name("values", t, i));
+            pending_unlinks.push_back(name);
+        }
+    }
+}
+
+/**
+ * solve from a state with one forked process per shard, like TwoProduct::solve
+ * @param state
+ * @return optimal final cash balance and the optimal order quantities of the state
+ */
+std::vector<double> ShardedSolver::solve(const StateMulti &state) {
+    prefix = "cash_shard_" + std::to_string(getpid()) + "_" + std::to_string(solve_count++) + "_";
+    const int T = problem.get_T();
+    const auto remove_files = [&] {
+        for (int t = state.get_period(); t <= T; t++) {
+            for (int i = 0; i < num_shards; i++) {
+                unlink(file_name("states", t, i).c_str());
+                unlink(file_name("values", t, i).c_str());
+            }
+        }
+    };
+
+    // the barrier followed by the number of owned states of each shard
+    const std::size_t shared_size =
+            sizeof(pthread_barrier_t) + num_shards * sizeof(std::uint64_t);
+    void *shared = mmap(nullptr, shared_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+        throw std::runtime_error("cannot map the shard barrier");
+    auto *barrier = static_cast<pthread_barrier_t *>(shared);
+    auto *owned_counts = reinterpret_cast<std::uint64_t *>(static_cast<char *>(shared) +
+                                                           sizeof(pthread_barrier_t));
+    pthread_barrierattr_t attr;
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(barrier, &attr, num_shards);
+    pthread_barrierattr_destroy(&attr);
+
+    std::vector<pid_t> workers;
+    bool failed = false;
+    for (int shard = 0; shard < num_shards; shard++) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            int status = 0;
+            try {
+                run_shard(shard, state, barrier, owned_counts + shard);
+            } catch (...) {
+                status = 1;
+            }
+            _exit(status);
+        }
+        if (pid < 0) {
+            failed = true;
+            break;
+        }
+        workers.push_back(pid);
+    }
+    // a failed shard leaves the others at the barrier, so they are stopped as well
+    if (failed) {
+        for (const pid_t pid: workers)
+            kill(pid, SIGKILL);
+    }
+    for (std::size_t finished = 0; finished < workers.size(); finished++) {
+        int status = 0;
+        const pid_t pid = wait(&status);
+        if (pid < 0)
+            break;
+        if (!failed && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+            failed = true;
+            for (const pid_t worker: workers)
+                kill(worker, SIGKILL);
+        }
+    }
+    pthread_barrier_destroy(barrier);
+    states_solved = 0;
+    for (int shard = 0; shard < num_shards; shard++)
+        states_solved += owned_counts[shard];
+    munmap(shared, shared_size);
+    if (failed) {
+        remove_files();
+        throw std::runtime_error("a shard of the sharded solve failed");
+    }
+
+    std::vector<double> results(3);
+    {
+        const MappedFile table(file_name("values", state.get_period(), shard_of(state)));
+        const auto *it =
+                std::find_if(table.begin<ValueRecord>(), table.end<ValueRecord>(),
+                             [&](const ValueRecord &record) { return record.state == state; });
+        if (it == table.end<ValueRecord>()) {
+            remove_files();
+            throw std::runtime_error("initial state missing from the value tables");
+        }
+        results[0] = it->value + state.get_ini_cash();
+        results[1] = it->q1;
+        results[2] = it->q2;
+    }
+    remove_files();
+    return results;
+}
@@ -0,0 +1,48 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description: multi-process solve of a TwoProduct model on one Linux host. The states of each
+ * period are partitioned over worker processes by hash or by the inventory of product 1. Workers
+ * publish the states they reach and the values they compute as memory-mapped files in a shared
+ * directory, and wait on a process-shared barrier at the end of every period.
+ *
+ *
+ */
+
+#ifndef SHARDED_SOLVER_H
+#define SHARDED_SOLVER_H
+
+#include <cstdint>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "state_multi.h"
+#include "two_product.h"
+
+enum class ShardPartition { hash, inventory };
+
+class ShardedSolver {
+    const TwoProduct &problem;
+    int num_shards;
+    ShardPartition partition;
+    std::string directory;
+    std::string prefix; // distinguishes the files of concurrent solves
+    std::size_t states_solved = 0; // owned states of all shards in the last solve
+
+    [[nodiscard]] int shard_of(const StateMulti &state) const;
+    [[nodiscard]] std::string file_name(const std::string &kind, int t, int shard) const;
+    void run_shard(int shard, const StateMulti &ini_state, pthread_barrier_t *barrier,
+                   std::uint64_t *owned_count) const;
+
+public:
+    ShardedSolver(const TwoProduct &problem, int num_shards,
+                  ShardPartition partition = ShardPartition::hash,
+                  std::string directory = "/dev/shm");
+
+    std::vector<double> solve(const StateMulti &state);
+    [[nodiscard]] std::size_t num_states() const { return states_solved; }
+};
+
+
+#endif // SHARDED_SOLVER_H
@@ -0,0 +1,207 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description:
+ *
+ *
+ */
+
+#include "stationary_solver.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+/**
+ * @param problem
+ * @param cash_step width of a cash bucket
+ * @param num_cash_buckets cash above the last bucket is kept in the last bucket
+ * @param discount discount factor per period, 0 takes 1 / (1 + interest rate); it has to be below
+ * 1 for the iteration to converge, so pass it explicitly when the interest rate is 0
+ * @param num_threads 0 takes the number of hardware threads
+ * @throws std::invalid_argument when the discount factor is not below 1
+ */
+StationarySolver::StationarySolver(const TwoProduct &problem, const double cash_step,
+                                   const int num_cash_buckets, const double discount,
+                                   const int num_threads) :
+    problem(problem), capacity(problem.get_capacity()), cash_step(cash_step),
+    num_cash_buckets(std::max(1, num_cash_buckets)),
+    discount(discount > 0 ? discount : 1 / (1 + problem.get_interest_rate())),
+    num_threads(num_threads > 0
+                        ? num_threads
+                        : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))) {
+    if (this->discount >= 1)
+        throw std::invalid_argument("the discount factor of a stationary solve must be below 1");
+    outcomes.resize(capacity * capacity);
+    std::vector<double> probs;
+    for (int y1 = 0; y1 < capacity; y1++) {
+        for (int y2 = 0; y2 < capacity; y2++) {
+            probs.assign((y1 + 1) * (y2 + 1), 0.0);
+            for (const auto demand_and_prob: problem.get_pmf()) {
+                const int sold1 = std::min(y1, static_cast<int>(demand_and_prob[0]));
+                const int sold2 = std::min(y2, static_cast<int>(demand_and_prob[1]));
+                probs[sold1 * (y2 + 1) + sold2] += demand_and_prob[2];
+            }
+            auto &pair_outcomes = outcomes[y1 * capacity + y2];
+            for (int i = 0; i < static_cast<int>(probs.size()); i++) {
+                if (probs[i] > 0)
+                    pair_outcomes.push_back({i / (y2 + 1), i % (y2 + 1), probs[i]});
+            }
+        }
+    }
+}
+
+/**
+ * order quantities of the policy for a state of the finite-horizon model: inventories above the
+ * grid take the actions of its last inventory and the cash is rounded down to its bucket, so the
+ * order is affordable
+ * @param state
+ * @return
+ */
+std::array<double, 2> StationaryPolicy::action(const StateMulti &state) const {
+    const int inventory1 = std::min(static_cast<int>(state.get_ini_inventory1()), capacity - 1);
+    const int inventory2 = std::min(static_cast<int>(state.get_ini_inventory2()), capacity - 1);
+    const int bucket =
+            StationarySolver::cash_bucket(state.get_ini_cash(), cash_step, num_cash_buckets);
+    const auto [q1, q2] = actions[(inventory1 * capacity + inventory2) * num_cash_buckets + bucket];
+    return {static_cast<double>(q1), static_cast<double>(q2)};
+}
+
+/**
+ * bucket of a cash balance, rounded down so that a bucket never holds more cash than was carried
+ * over and its actions stay affordable; the cash above the bucket is lost, which biases the
+ * values down by up to one cash_step per period. 1e-9 absorbs the round-off of the division
+ */
+int StationarySolver::cash_bucket(const double cash, const double cash_step,
+                                  const int num_cash_buckets) {
+    return std::clamp(static_cast<int>(std::floor(cash / cash_step + 1e-9)), 0,
+                      num_cash_buckets - 1);
+}
+
+/**
+ * one Gauss-Seidel sweep over the states [first_state, last_state); values of other threads are
+ * read as they are updated
+ * @param improve choose the best action of each state, otherwise evaluate the current actions
+ * @return largest change of a value
+ */
+double StationarySolver::sweep(const int first_state, const int last_state,
+                               std::vector<std::atomic<double>> &values,
+                               std::vector<std::array<int, 2>> &actions, const bool improve) const {
+    const auto &prices = problem.get_prices();
+    const auto &unit_order_costs = problem.get_unit_order_costs();
+    const double interest_rate = problem.get_interest_rate();
+
+    // expected cash flow plus discounted next value of ordering q1 and q2
+    const auto action_value = [&](const int inventory1, const int inventory2, const double cash,
+                                  const int q1, const int q2) {
+        const int y1 = inventory1 + q1;
+        const int y2 = inventory2 + q2;
+        const double ordering_costs = unit_order_costs[0] * q1 + unit_order_costs[1] * q2;
+        const double carried_cash = (cash - ordering_costs) * (1 + interest_rate);
+        double this_value = 0.0;
+        for (const auto &[sold1, sold2, prob]: outcomes[y1 * capacity + y2]) {
+            const double next_cash = carried_cash + prices[0] * sold1 + prices[1] * sold2;
+            const int next = index(y1 - sold1, y2 - sold2,
+                                   cash_bucket(next_cash, cash_step, num_cash_buckets));
+            this_value +=
+                    prob * (next_cash - cash +
+                            discount * values[next].load(std::memory_order_relaxed));
+        }
+        return this_value;
+    };
+
+    double residual = 0.0;
+    for (int state = first_state; state < last_state; state++) {
+        const int bucket = state % num_cash_buckets;
+        const int inventory2 = state / num_cash_buckets % capacity;
+        const int inventory1 = state / num_cash_buckets / capacity;
+        const double cash = bucket * cash_step;
+
+        double best_value;
+        if (improve) {
+            best_value = std::numeric_limits<double>::lowest();
+            // 1e-9 absorbs the round-off of the bucket cash
+            for (int q1 = 0; inventory1 + q1 < capacity &&
+                             unit_order_costs[0] * q1 <= cash + 1e-9;
+                 q1++) {
+                for (int q2 = 0; inventory2 + q2 < capacity &&
+                                 unit_order_costs[0] * q1 + unit_order_costs[1] * q2 <= cash + 1e-9;
+                     q2++) {
+                    if (const double this_value =
+                                action_value(inventory1, inventory2, cash, q1, q2);
+                        this_value > best_value) {
+                        best_value = this_value;
+                        actions[state] = {q1, q2};
+                    }
+                }
+            }
+        } else {
+            best_value = action_value(inventory1, inventory2, cash, actions[state][0],
+                                      actions[state][1]);
+        }
+        residual = std::fmax(residual,
+                             std::fabs(best_value - values[state].load(std::memory_order_relaxed)));
+        values[state].store(best_value, std::memory_order_relaxed);
+    }
+    return residual;
+}
+
+/**
+ * modified policy iteration: each iteration is one improving sweep followed by evaluation sweeps
+ * of the improved policy, all of them Gauss-Seidel sweeps split over the threads
+ * @param tolerance stop when an improving sweep changes no value by more than this
+ * @param max_iterations
+ * @param evaluation_sweeps 0 gives plain value iteration
+ * @return
+ */
+StationaryPolicy StationarySolver::solve(const double tolerance, const int max_iterations,
+                                         const int evaluation_sweeps) const {
+    const int num_states = capacity * capacity * num_cash_buckets;
+    std::vector<std::atomic<double>> values(num_states);
+    std::vector<std::array<int, 2>> actions(num_states);
+    const int threads = std::min(num_threads, num_states);
+    const int block = (num_states + threads - 1) / threads;
+
+    const auto parallel_sweep = [&](const bool improve) {
+        std::vector<double> residuals(threads);
+        std::vector<std::thread> workers;
+        for (int k = 1; k < threads; k++)
+            workers.emplace_back([&, k] {
+                residuals[k] = sweep(k * block, std::min(num_states, (k + 1) * block), values,
+                                     actions, improve);
+            });
+        residuals[0] = sweep(0, std::min(num_states, block), values, actions, improve);
+        for (auto &worker: workers)
+            worker.join();
+        return *std::max_element(residuals.begin(), residuals.end());
+    };
+
+    StationaryPolicy policy{};
+    policy.capacity = capacity;
+    policy.num_cash_buckets = num_cash_buckets;
+    policy.cash_step = cash_step;
+    policy.residual = std::numeric_limits<double>::max();
+    for (policy.iterations = 1; policy.iterations <= max_iterations; policy.iterations++) {
+        policy.residual = parallel_sweep(true);
+        if (policy.residual < tolerance) {
+            policy.converged = true;
+            break;
+        }
+        for (int i = 0; i < evaluation_sweeps; i++)
+            parallel_sweep(false);
+    }
+    policy.iterations = std::min(policy.iterations, max_iterations);
+
+    policy.values.resize(num_states);
+    for (int state = 0; state < num_states; state++)
+        policy.values[state] = values[state].load(std::memory_order_relaxed);
+    policy.actions = std::move(actions);
+    policy.a_stars = policy.actions[index(0, 0, num_cash_buckets - 1)];
+    const auto &unit_order_costs = problem.get_unit_order_costs();
+    const double a_stars_cost =
+            unit_order_costs[0] * policy.a_stars[0] + unit_order_costs[1] * policy.a_stars[1];
+    policy.cash_bound = a_stars_cost + std::fmax(unit_order_costs[0], unit_order_costs[1]) >
+                        (num_cash_buckets - 1) * cash_step + 1e-9;
+    return policy;
+}
@@ -0,0 +1,78 @@
+/*
+ * Created by Zhen Chen on 2026/10/19.
+ * Email: chen.zhen5526@gmail.com
+ * Description: infinite-horizon stationary policy of a TwoProduct model over a grid of
+ * (inventory 1, inventory 2, cash bucket) by modified policy iteration with parallel Gauss-Seidel
+ * sweeps.
+ * Inventories are in [0, capacity), cash buckets are multiples of cash_step and the value is the
+ * discounted sum of the cash flows of each period. Next-period cash is rounded down to its bucket,
+ * so the policy is always affordable but the values are biased down.
+ *
+ *
+ */
+
+#ifndef STATIONARY_SOLVER_H
+#define STATIONARY_SOLVER_H
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include "state_multi.h"
+#include "two_product.h"
+
+struct StationaryPolicy {
+    int capacity;
+    int num_cash_buckets;
+    double cash_step;
+    std::vector<double> values; // indexed by StationarySolver::index
+    std::vector<std::array<int, 2>> actions; // order quantities of each state
+    // order-up-to levels from zero inventory in the top cash bucket; they are the unconstrained
+    // a* only when that cash covers them, so check cash_bound
+    std::array<int, 2> a_stars;
+    // the top bucket cannot afford one more unit of either product on top of a_stars, so a_stars
+    // may be a cash-constrained order; use more buckets or a larger cash_step until this is false
+    bool cash_bound;
+    int iterations;
+    double residual; // largest value change of the last sweep
+    bool converged;
+
+    [[nodiscard]] std::array<double, 2> action(const StateMulti &state) const;
+};
+
+class StationarySolver {
+    // sales and probability of the demands that lead to them
+    struct Outcome {
+        int sold1;
+        int sold2;
+        double prob;
+    };
+
+    const TwoProduct &problem;
+    int capacity;
+    double cash_step;
+    int num_cash_buckets;
+    double discount;
+    int num_threads;
+    // outcomes of the pmf for each pair of order-up-to levels, indexed by y1 * capacity + y2;
+    // demands above a level give the same sales, so they are merged
+    std::vector<std::vector<Outcome>> outcomes;
+
+    double sweep(int first_state, int last_state, std::vector<std::atomic<double>> &values,
+                 std::vector<std::array<int, 2>> &actions, bool improve) const;
+
+public:
+    static int cash_bucket(double cash, double cash_step, int num_cash_buckets);
+
+    StationarySolver(const TwoProduct &problem, double cash_step, int num_cash_buckets,
+                     double discount = 0.0, int num_threads = 0);
+
+    [[nodiscard]] int index(int inventory1, int inventory2, int bucket) const {
+        return (inventory1 * capacity + inventory2) * num_cash_buckets + bucket;
+    }
+
+    StationaryPolicy solve(double tolerance, int max_iterations, int evaluation_sweeps = 20) const;
+};
+
+
+#endif // STATIONARY_SOLVER_H
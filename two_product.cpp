@@ -8,7 +8,11 @@
 
 #include "two_product.h"
 #include <boost/math/distributions/gamma.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
 #include "pmf.h"
 
 TwoProduct::TwoProduct(const int T, const int capacity, const double max_I,
@@ -17,14 +21,120 @@ TwoProduct::TwoProduct(const int T, const int capacity, const double max_I,
                        const std::vector<double> &unit_salvage_values,
                        const std::vector<std::array<double, 3>> &pmf) :
     T(T), capacity(capacity), max_I(max_I), interest_rate(interest_rate), prices(prices),
-    unit_order_costs(unit_order_costs), unit_salvage_values(unit_salvage_values), pmf(pmf) {}
+    unit_order_costs(unit_order_costs), unit_salvage_values(unit_salvage_values), pmf(pmf),
+    num_threads(static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))) {}
+
+void TwoProduct::set_num_threads(const int n) { num_threads = std::max(1, n); }
+
+/**
+ * load the a* levels and G tables of get_a_stars from a directory when the same product
+ * parameters were computed before, and save them there otherwise
+ * @param directory an empty string turns the store off
+ */
+void TwoProduct::set_g_table_store(const std::string &directory) {
+    g_table_store = directory.empty() ? nullptr : std::make_shared<const GTableStore>(directory);
+}
+
+/**
+ * everything the G table of one product depends on
+ * @param index 0 or 1
+ */
+GTableKey TwoProduct::g_table_key(const int index) const {
+    // 2: a* is the smallest y within round-off of the maximum of G
+    constexpr std::uint32_t g_algorithm_version = 2;
+    return {g_algorithm_version, T, capacity, interest_rate, prices[index],
+            unit_order_costs[index], unit_salvage_values[index], pmfs[index]};
+}
+
+/**
+ * keep cash in integer units of 1 / scale, e.g. 100 for cents; prices, costs, salvage values and
+ * interest are rounded to this unit so that equal cash always gives the same state key; the
+ * memos are cleared since their keys were made in the old mode
+ * @param scale 0 turns the fixed-point mode off
+ */
+void TwoProduct::set_cash_scale(const int scale) {
+    cash_scale = std::max(0, scale);
+    clear_memos();
+    for (int i = 0; i < 2; i++) {
+        price_units[i] = to_cash_units(prices[i]);
+        order_cost_units[i] = to_cash_units(unit_order_costs[i]);
+        salvage_units[i] = to_cash_units(unit_salvage_values[i]);
+    }
+}
+
+// rounds half away from zero like std::llround, without the library call in the inner loops
+static long long round_units(const double x) {
+    return static_cast<long long>(x < 0 ? x - 0.5 : x + 0.5);
+}
+
+/**
+ * store the values and actions of recursion as float values and 16-bit order quantities, which
+ * needs capacity below 65536; get_compact_max_error reports the largest rounding error of a single
+ * stored value, not the error of the final value, which the recursion_compact gap of the harness
+ * measures against an exact run
+ * @param compact
+ * @param delta_encoded store each value as a float delta from the first value of its period
+ * @throws std::invalid_argument when compact and the capacity does not fit 16 bits
+ */
+void TwoProduct::set_compact_memo(const bool compact, const bool delta_encoded) {
+    if (compact and capacity > std::numeric_limits<std::uint16_t>::max())
+        throw std::invalid_argument("the compact memo needs a capacity below 65536");
+    compact_memo = compact;
+    cache_compact = CompactMemo(delta_encoded);
+}
+
+long long TwoProduct::to_cash_units(const double cash) const {
+    return round_units(cash * cash_scale);
+}
+
+/**
+ * whether the inventory is at or above the level; inventories are whole numbers in the
+ * fixed-point mode, otherwise a tolerance absorbs the round-off of fractional orders
+ */
+bool TwoProduct::reaches(const double inventory, const int level) const {
+    return cash_scale > 0 ? inventory >= level : inventory > level - 1e-1;
+}
+
+/**
+ * whether the cash of the state can raise the inventories up to the two levels
+ */
+bool TwoProduct::affords(const StateMulti &state, const double level1, const double level2) const {
+    if (cash_scale > 0) {
+        const long long cost =
+                order_cost_units[0] * round_units(level1 - state.get_ini_inventory1()) +
+                order_cost_units[1] * round_units(level2 - state.get_ini_inventory2());
+        return cost <= to_cash_units(state.get_ini_cash());
+    }
+    return state.get_ini_cash() > unit_order_costs[0] * (level1 - state.get_ini_inventory1()) +
+                                          unit_order_costs[1] *
+                                                  (level2 - state.get_ini_inventory2());
+}
+
+/**
+ * the highest inventory the cash of the state can buy for one product, whole units in the
+ * fixed-point mode
+ * @param state
+ * @param product_index 1 or 2
+ */
+double TwoProduct::max_order_up_to(const StateMulti &state, const int product_index) const {
+    const int index = product_index - 1;
+    const double inventory =
+            index == 0 ? state.get_ini_inventory1() : state.get_ini_inventory2();
+    if (cash_scale > 0)
+        return inventory +
+               static_cast<double>(to_cash_units(state.get_ini_cash()) / order_cost_units[index]);
+    return state.get_ini_cash() / unit_order_costs[index] + inventory;
+}
 
 std::vector<std::array<double, 2>> TwoProduct::feasible_actions(const StateMulti &state) const {
     std::vector<std::array<double, 2>> actions;
     actions.reserve(static_cast<int>(capacity) * static_cast<int>(capacity));
+    const long long cash_units = to_cash_units(state.get_ini_cash());
     for (int q1 = 0; q1 < capacity; q1++) {
         for (int q2 = 0; q2 < capacity; q2++) {
-            if (unit_order_costs[0] * q1 + unit_order_costs[1] * q2 < state.get_ini_cash() + 1e-1) {
+            if (cash_scale > 0 ? order_cost_units[0] * q1 + order_cost_units[1] * q2 <= cash_units
+                               : unit_order_costs[0] * q1 + unit_order_costs[1] * q2 <
+                                         state.get_ini_cash() + 1e-1) {
                 actions.emplace_back(std::array{static_cast<double>(q1), static_cast<double>(q2)});
             }
         }
@@ -42,6 +152,12 @@ StateMulti TwoProduct::state_transition(const StateMulti &ini_state,
     end_inventory1 = max_I < end_inventory1 ? max_I : end_inventory1;
     end_inventory2 = max_I < end_inventory2 ? max_I : end_inventory2;
 
+    if (cash_scale > 0) {
+        const long long next_cash_units = to_cash_units(ini_state.get_ini_cash()) +
+                                          immediate_value_units(ini_state, actions, demands);
+        return StateMulti{ini_state.get_period() + 1, end_inventory1, end_inventory2,
+                          static_cast<double>(next_cash_units) / cash_scale};
+    }
     const double next_cash =
             ini_state.get_ini_cash() + immediate_value(ini_state, actions, demands);
     return StateMulti{ini_state.get_period() + 1, end_inventory1, end_inventory2, next_cash};
@@ -50,6 +166,9 @@ StateMulti TwoProduct::state_transition(const StateMulti &ini_state,
 double TwoProduct::immediate_value(const StateMulti &ini_state,
                                    const std::array<double, 2> &actions,
                                    const std::array<double, 2> &demands) const {
+    if (cash_scale > 0)
+        return static_cast<double>(immediate_value_units(ini_state, actions, demands)) /
+               cash_scale;
     double end_inventory1 =
             std::fmax<double>(ini_state.get_ini_inventory1() + actions[0] - demands[0], 0.0);
     double end_inventory2 =
@@ -72,170 +191,308 @@ double TwoProduct::immediate_value(const StateMulti &ini_state,
     return revenue1 + revenue2 + salvage_value + interest - ordering_costs;
 }
 
+/**
+ * immediate value in integer cash units, the interest is rounded to the nearest unit
+ * @param ini_state
+ * @param actions
+ * @param demands
+ * @return
+ */
+long long TwoProduct::immediate_value_units(const StateMulti &ini_state,
+                                            const std::array<double, 2> &actions,
+                                            const std::array<double, 2> &demands) const {
+    const auto max_inventory = static_cast<long long>(max_I);
+    const std::array inventories = {round_units(ini_state.get_ini_inventory1()),
+                                    round_units(ini_state.get_ini_inventory2())};
+    long long value = 0;
+    long long ordering_costs = 0;
+    for (int i = 0; i < 2; i++) {
+        const long long q = round_units(actions[i]);
+        const long long end_inventory =
+                std::clamp(inventories[i] + q - round_units(demands[i]), 0LL, max_inventory);
+        value += price_units[i] * (inventories[i] + q - end_inventory);
+        if (ini_state.get_period() == T)
+            value += salvage_units[i] * end_inventory;
+        ordering_costs += order_cost_units[i] * q;
+    }
+    const long long interest = round_units(
+            interest_rate * static_cast<double>(to_cash_units(ini_state.get_ini_cash()) -
+                                                ordering_costs));
+    return value + interest - ordering_costs;
+}
+
+
+/**
+ * immediate value of an action under some demands, with the next state written to next_state
+ * before the last period; the same arithmetic as immediate_value and state_transition, done once
+ * for both
+ */
+template<bool with_interest, bool fixed_point, bool last_period>
+double TwoProduct::engine_step(const StateMulti &state, const std::array<double, 2> &action,
+                               const std::array<double, 2> &demands,
+                               StateMulti &next_state) const {
+    double end_inventory1 =
+            std::fmax<double>(state.get_ini_inventory1() + action[0] - demands[0], 0.0);
+    double end_inventory2 =
+            std::fmax<double>(state.get_ini_inventory2() + action[1] - demands[1], 0.0);
+    end_inventory1 = max_I < end_inventory1 ? max_I : end_inventory1;
+    end_inventory2 = max_I < end_inventory2 ? max_I : end_inventory2;
+
+    if constexpr (fixed_point) {
+        const auto max_inventory = static_cast<long long>(max_I);
+        const std::array inventories = {round_units(state.get_ini_inventory1()),
+                                        round_units(state.get_ini_inventory2())};
+        const long long cash_units = to_cash_units(state.get_ini_cash());
+        long long value = 0;
+        long long ordering_costs = 0;
+        for (int i = 0; i < 2; i++) {
+            const long long q = round_units(action[i]);
+            const long long end_inventory =
+                    std::clamp(inventories[i] + q - round_units(demands[i]), 0LL, max_inventory);
+            value += price_units[i] * (inventories[i] + q - end_inventory);
+            if constexpr (last_period)
+                value += salvage_units[i] * end_inventory;
+            ordering_costs += order_cost_units[i] * q;
+        }
+        if constexpr (with_interest)
+            value += round_units(interest_rate *
+                                 static_cast<double>(cash_units - ordering_costs));
+        value -= ordering_costs;
+        if constexpr (!last_period)
+            next_state = StateMulti{state.get_period() + 1, end_inventory1, end_inventory2,
+                                    static_cast<double>(cash_units + value) / cash_scale};
+        return static_cast<double>(value) / cash_scale;
+    } else {
+        const double revenue1 =
+                prices[0] * (state.get_ini_inventory1() + action[0] - end_inventory1);
+        const double revenue2 =
+                prices[1] * (state.get_ini_inventory2() + action[1] - end_inventory2);
+        const double ordering_costs =
+                unit_order_costs[0] * action[0] + unit_order_costs[1] * action[1];
+        double salvage_value = 0.0;
+        if constexpr (last_period)
+            salvage_value = unit_salvage_values[0] * end_inventory1 +
+                            unit_salvage_values[1] * end_inventory2;
+        double value = revenue1 + revenue2 + salvage_value;
+        if constexpr (with_interest)
+            value += interest_rate * (state.get_ini_cash() - ordering_costs);
+        value -= ordering_costs;
+        if constexpr (!last_period)
+            next_state = StateMulti{state.get_period() + 1, end_inventory1, end_inventory2,
+                                    state.get_ini_cash() + value};
+        return value;
+    }
+}
 
 /**
- * get the action value when computing DP using a*
+ * expected value of an action, looking the next states up in the memo of the rule and solving
+ * the missing ones
  * @param state
  * @param action
  * @return
  */
-double
-TwoProduct::get_action_value(const StateMulti &state,
-                             const std::array<double, 2> &action) { // NOLINT(misc-no-recursion)
+template<RecursionRule rule, bool with_interest, bool fixed_point>
+double TwoProduct::engine_action_value(const StateMulti &state, // NOLINT(*-no-recursion)
+                                       const std::array<double, 2> &action) {
     double this_value = 0;
-    for (const auto demand_and_prob: pmf) {
-        const auto demands = std::array{demand_and_prob[0], demand_and_prob[1]};
-        this_value += demand_and_prob[2] * immediate_value(state, action, demands);
-        if (state.get_period() < T) {
-            auto new_state = state_transition(state, action, demands);
-            auto it = cache_value2.find(new_state);
-            if (it != cache_value2.end())
-                this_value += demand_and_prob[2] * it->second;
-            else {
-                const double next_value = recursion2(new_state);
-                this_value += demand_and_prob[2] * next_value;
-            }
-        }
+    StateMulti next_state;
+    if (state.get_period() >= T) {
+        for (const auto demand_and_prob: pmf)
+            this_value += demand_and_prob[2] *
+                          engine_step<with_interest, fixed_point, true>(
+                                  state, action, {demand_and_prob[0], demand_and_prob[1]},
+                                  next_state);
+        return this_value;
     }
-    return this_value;
-}
 
-double TwoProduct::get_action_value_heuristic1(
-        const StateMulti &state, const std::array<double, 2> &action) { // NOLINT(misc-no-recursion)
-    double this_value = 0;
+    auto &memo = rule == RecursionRule::exact      ? cache_values
+                 : rule == RecursionRule::theorem2 ? cache_value2
+                                                   : cache_values_heuristic1;
     for (const auto demand_and_prob: pmf) {
-        const auto demands = std::array{demand_and_prob[0], demand_and_prob[1]};
-        this_value += demand_and_prob[2] * immediate_value(state, action, demands);
-        if (state.get_period() < T) {
-            auto new_state = state_transition(state, action, demands);
-            auto it = cache_values_heuristic1.find(new_state);
-            if (it != cache_values_heuristic1.end())
-                this_value += demand_and_prob[2] * it->second;
-            else {
-                const double next_value = heuristic1_2(new_state);
-                this_value += demand_and_prob[2] * next_value;
-            }
-        }
+        this_value += demand_and_prob[2] *
+                      engine_step<with_interest, fixed_point, false>(
+                              state, action, {demand_and_prob[0], demand_and_prob[1]},
+                              next_state);
+        double next_value;
+        if constexpr (rule == RecursionRule::exact_compact) {
+            if (!cache_compact.find(next_state, next_value))
+                next_value = recursion_engine<rule, with_interest, fixed_point>(next_state);
+        } else if (const auto it = memo.find(next_state); it != memo.end())
+            next_value = it->second;
+        else
+            next_value = recursion_engine<rule, with_interest, fixed_point>(next_state);
+        this_value += demand_and_prob[2] * next_value;
     }
     return this_value;
 }
 
+/**
+ * the recursion of every rule: the a* rules order by Theorem 2 when one product reaches its a*
+ * or both a* are affordable, the G-table rule estimates the other states before period T from the
+ * G tables, and the rest search all feasible actions
+ * @param state
+ * @return
+ */
+template<RecursionRule rule, bool with_interest, bool fixed_point>
+double TwoProduct::recursion_engine(const StateMulti &state) { // NOLINT(*-no-recursion)
+    if constexpr (rule == RecursionRule::theorem2 or rule == RecursionRule::g_table) {
+        auto &memo = rule == RecursionRule::theorem2 ? cache_value2 : cache_values_heuristic1;
+        const int t_index = state.get_period() - 1;
+        const int a1_star = astar_G[0][t_index];
+        const int a2_star = astar_G[1][t_index];
+        const bool reaches1 = reaches(state.get_ini_inventory1(), a1_star);
+        const bool reaches2 = reaches(state.get_ini_inventory2(), a2_star);
+        if (reaches1 or reaches2 or affords(state, a1_star, a2_star)) {
+            std::array<double, 2> action{};
+            if (reaches1 and not reaches2)
+                action[1] = std::fmin(a2_star, max_order_up_to(state, 2));
+            else if (not reaches1 and reaches2)
+                action[0] = std::fmin(a1_star, max_order_up_to(state, 1));
+            else if (not reaches1 and not reaches2)
+                action = {static_cast<double>(a1_star), static_cast<double>(a2_star)};
+            const double value =
+                    engine_action_value<rule, with_interest, fixed_point>(state, action);
+            memo[state] = value;
+            return value;
+        }
+        if constexpr (rule == RecursionRule::g_table) {
+            const double value =
+                    state.get_period() < T
+                            ? g_estimate(state)
+                            : engine_action_value<rule, with_interest, fixed_point>(state,
+                                                                                    {0.0, 0.0});
+            memo[state] = value;
+            return value;
+        }
+    }
 
-double TwoProduct::recursion(const StateMulti &state) { // NOLINT(*-no-recursion)
-    double best_q1 = 0.0;
-    double best_q2 = 0.0;
     double best_value = std::numeric_limits<double>::lowest();
-    const std::vector<std::array<double, 2>> actions = feasible_actions(state);
-    for (const std::array action: actions) {
-        double this_value = 0;
-        for (const auto demand_and_prob: pmf) {
-            const auto demands = std::array{demand_and_prob[0], demand_and_prob[1]};
-            this_value += demand_and_prob[2] * immediate_value(state, action, demands);
-            if (state.get_period() < T) {
-                auto new_state = state_transition(state, action, demands);
-                auto it = cache_values.find(new_state);
-                if (it != cache_values.end())
-                    this_value += demand_and_prob[2] * it->second;
-                else {
-                    const double next_value = recursion(new_state); // NOLINT(misc-no-recursion)
-                    this_value += demand_and_prob[2] * next_value;
-                }
-            }
-        }
-        if (this_value > best_value) {
+    std::array<double, 2> best_action{};
+    for (const std::array action: feasible_actions(state)) {
+        if (const double this_value =
+                    engine_action_value<rule, with_interest, fixed_point>(state, action);
+            this_value > best_value) {
             best_value = this_value;
-            best_q1 = action[0];
-            best_q2 = action[1];
+            best_action = action;
         }
     }
-    cache_values[state] = best_value;
-    cache_actions[state] = std::array{best_q1, best_q2};
+    if constexpr (rule == RecursionRule::exact) {
+        cache_values[state] = best_value;
+        cache_actions[state] = best_action;
+    } else if constexpr (rule == RecursionRule::exact_compact)
+        return cache_compact.insert(state, best_value, best_action);
+    else
+        cache_value2[state] = best_value;
     return best_value;
 }
 
 /**
- * recursion using the values of a* and Theorem 2
+ * pick the instantiation of the engine for the interest rate and the cash mode of the problem
  * @param state
  * @return
  */
-double TwoProduct::recursion2(const StateMulti &state) { // NOLINT(*-no-recursion)
-    const int a1_star = astar_G[0][state.get_period() - 1];
-    const int a2_star = astar_G[1][state.get_period() - 1];
-    if (state.get_ini_inventory1() > a1_star - 1e-1 and
-        state.get_ini_inventory2() > a2_star - 1e-1) {
-        cache_value2[state] = get_action_value(state, {0.0, 0.0});
-        return cache_value2[state];
-    }
-    if (state.get_ini_inventory1() > a1_star - 1e-1 and
-        state.get_ini_inventory2() < a2_star - 1e-1) {
-        const double q = std::fmin(a2_star, state.get_ini_cash() / unit_order_costs[1] +
-                                                    state.get_ini_inventory2());
-        cache_value2[state] = get_action_value(state, {0.0, q});
-        return cache_value2[state];
-    }
-    if (state.get_ini_inventory1() < a1_star - 1e-1 and
-        state.get_ini_inventory2() > a2_star - 1e-1) {
-        const double q = std::fmin(a1_star, state.get_ini_cash() / unit_order_costs[0] +
-                                                    state.get_ini_inventory1());
-        cache_value2[state] = get_action_value(state, {q, 0.0});
-        return cache_value2[state];
+template<RecursionRule rule>
+double TwoProduct::run_recursion(const StateMulti &state) {
+    if (cash_scale > 0)
+        return interest_rate != 0.0 ? recursion_engine<rule, true, true>(state)
+                                    : recursion_engine<rule, false, true>(state);
+    return interest_rate != 0.0 ? recursion_engine<rule, true, false>(state)
+                                : recursion_engine<rule, false, false>(state);
+}
+
+double TwoProduct::recursion(const StateMulti &state) {
+    return compact_memo ? run_recursion<RecursionRule::exact_compact>(state)
+                        : run_recursion<RecursionRule::exact>(state);
+}
+
+/**
+ * replace the joint pmf, e.g. by a reduced one, and drop the values computed with the old one
+ * @param new_pmf
+ */
+void TwoProduct::set_pmf(const std::vector<std::array<double, 3>> &new_pmf) {
+    pmf = new_pmf;
+    clear_memos();
+}
+
+// drop the values of all recursions, e.g. after a change of the model or of the state keys
+void TwoProduct::clear_memos() {
+    cache_values.clear();
+    cache_actions.clear();
+    cache_value2.clear();
+    cache_values_heuristic1.clear();
+    cache_values_heuristic2.clear();
+    cache_compact = CompactMemo(cache_compact.is_delta_encoded());
+    cache_lookahead.clear();
+}
+
+/**
+ * optimal order quantities of a state, solving from it when it has not been visited
+ * @param state
+ * @return
+ */
+std::array<double, 2> TwoProduct::policy_action(const StateMulti &state) {
+    if (compact_memo) {
+        double value;
+        if (!cache_compact.find(state, value))
+            recursion(state);
+        return cache_compact.get_action(state);
     }
-    if (state.get_ini_inventory1() < a1_star - 1e-1 and
-        state.get_ini_inventory2() < a2_star - 1e-1) {
-        if (state.get_ini_cash() >
-            unit_order_costs[0] * (a1_star - state.get_ini_inventory1()) +
-                    unit_order_costs[1] * (a2_star - state.get_ini_inventory2())) {
-            cache_value2[state] = get_action_value(
-                    state, {static_cast<double>(a1_star), static_cast<double>(a2_star)});
-            return cache_value2[state];
-        }
+    if (!cache_actions.contains(state))
+        recursion(state);
+    return cache_actions[state];
+}
+
+/**
+ * expected final cash balance under the pmf of this problem when ordering by the optimal policy
+ * of another problem, e.g. one solved with a reduced pmf
+ * @param state
+ * @param policy
+ * @return
+ */
+double TwoProduct::evaluate_policy(const StateMulti &state, TwoProduct &policy) {
+    return evaluate_policy(
+            state, [&policy](const StateMulti &s) { return policy.policy_action(s); });
+}
+
+/**
+ * expected final cash balance under the pmf of this problem when ordering by any policy, e.g. a
+ * stationary one; the policy has to return affordable order quantities
+ * @param state
+ * @param policy order quantities of a state
+ * @return
+ */
+double TwoProduct::evaluate_policy(const StateMulti &state, const OrderPolicy &policy) {
+    std::unordered_map<StateMulti, double> values;
+    return evaluate_policy(state, policy, values) + state.get_ini_cash();
+}
+
+double TwoProduct::evaluate_policy(const StateMulti &state, const OrderPolicy &policy, // NOLINT
+                                   std::unordered_map<StateMulti, double> &values) {
+    const auto action = policy(state);
+    double this_value = 0;
+    for (const auto demand_and_prob: pmf) {
+        const auto demands = std::array{demand_and_prob[0], demand_and_prob[1]};
+        this_value += demand_and_prob[2] * immediate_value(state, action, demands);
         if (state.get_period() < T) {
-            const int a1_star_next = astar_G[0][state.get_period() - 1];
-            if (const int a2_star_next = astar_G[1][state.get_period() - 1];
-                state.get_ini_cash() >
-                unit_order_costs[0] * (a1_star_next - state.get_ini_inventory1()) +
-                        unit_order_costs[1] * (a2_star_next - state.get_ini_inventory2())) {
-                const int t_index = state.get_period() - 1;
-                double best_value = std::numeric_limits<double>::lowest();
-                double this_value = 0.0;
-                // int best_y1 = 0;
-                for (int y = static_cast<int>(state.get_ini_inventory1()); y < capacity; y++) {
-                    const int y2 = static_cast<int>(
-                            state.get_ini_inventory2() +
-                            (state.get_ini_cash() -
-                             unit_order_costs[0] * (y - state.get_ini_inventory1())) /
-                                    unit_order_costs[1]);
-                    this_value = cache_valuesG[0][t_index][y] + cache_valuesG[1][t_index][y2];
-                    if (this_value > best_value) {
-                        best_value = this_value;
-                        // best_y1 = y;
-                    }
-                }
-                // double addition = state.get_ini_cash() + unit_order_costs[0] *
-                // state.get_ini_inventory1() +
-                // unit_order_costs[1] * state.get_ini_inventory2();
-                // addition *= std::pow(1 + interest_rate, T - t_index);
-                cache_value2[state] = best_value; // + addition;
-                return cache_value2[state];
-
-                // const double q1 = best_y1 - state.get_ini_inventory1();
-                // const double q2 = (state.get_ini_cash() - unit_order_costs[0] * q1) /
-                //                   unit_order_costs[1];
-                // cache_value2[state] = get_action_value(state, {q1, q2});
-                // return cache_value2[state];
-            }
+            const auto new_state = state_transition(state, action, demands);
+            const auto it = values.find(new_state);
+            const double next_value = it != values.end()
+                                              ? it->second
+                                              : evaluate_policy(new_state, policy, values);
+            this_value += demand_and_prob[2] * next_value;
         }
     }
+    values[state] = this_value;
+    return this_value;
+}
 
-    double best_value = std::numeric_limits<double>::lowest();
-    const std::vector<std::array<double, 2>> actions = feasible_actions(state);
-    for (const std::array action: actions) {
-        if (const double this_value = get_action_value(state, action); this_value > best_value) {
-            best_value = this_value;
-        }
-    }
-    cache_value2[state] = best_value;
-    return best_value;
+/**
+ * recursion using the values of a* and Theorem 2
+ * @param state
+ * @return
+ */
+double TwoProduct::recursion2(const StateMulti &state) {
+    return run_recursion<RecursionRule::theorem2>(state);
 }
 
 /**
@@ -243,97 +500,195 @@ double TwoProduct::recursion2(const StateMulti &state) { // NOLINT(*-no-recursio
  * @param state
  * @return
  */
-double TwoProduct::heuristic1(const StateMulti &state) const {
-    double this_value = 0.0;
+double TwoProduct::heuristic1(const StateMulti &state) const { return g_table_value(state, 0); }
+
+/**
+ * get final value from applying heuristic in recursion
+ * @param state
+ * @return
+ */
+double TwoProduct::heuristic1_2(const StateMulti &state) {
+    return run_recursion<RecursionRule::g_table>(state);
+}
+
+
+/**
+ * G-table estimate of the final cash balance from a state of any period, the counterpart of
+ * heuristic1 for later periods; needs get_a_stars
+ * @param state
+ * @return
+ */
+double TwoProduct::g_estimate(const StateMulti &state) const {
+    return g_table_value(state, state.get_period() - 1);
+}
+
+/**
+ * best sum of the two G tables of a stage over the order-up-to levels the cash of the state can
+ * reach, plus the compounded value of the cash and the inventories. Levels beyond the tables
+ * are clamped to their last entry.
+ * @param state
+ * @param t_index stage of the G tables
+ * @return
+ */
+double TwoProduct::g_table_value(const StateMulti &state, const int t_index) const {
     double best_value = std::numeric_limits<double>::lowest();
-    for (int y = static_cast<int>(state.get_ini_inventory1()); y < capacity; y++) {
+    for (int y = std::min(static_cast<int>(state.get_ini_inventory1()), capacity - 1);
+         y < capacity; y++) {
         const int y2 = static_cast<int>(
                 state.get_ini_inventory2() +
                 (state.get_ini_cash() - unit_order_costs[0] * (y - state.get_ini_inventory1())) /
                         unit_order_costs[1]);
-        this_value = cache_valuesG[0][0][y] + cache_valuesG[1][0][y2];
+        if (y2 < 0)
+            break;
+        const double this_value = cache_valuesG[0][t_index][y] +
+                                  cache_valuesG[1][t_index][std::min(y2, capacity - 1)];
         if (this_value > best_value) {
             best_value = this_value;
         }
     }
-    double addition = state.get_ini_cash() + unit_order_costs[0] * state.get_ini_inventory1() +
-                      unit_order_costs[1] * state.get_ini_inventory2();
-    addition *= std::pow(1 + interest_rate, T);
-    return best_value + addition;
+    const double addition = state.get_ini_cash() +
+                            unit_order_costs[0] * state.get_ini_inventory1() +
+                            unit_order_costs[1] * state.get_ini_inventory2();
+    return best_value + addition * discount_factors[t_index];
 }
 
 /**
- * get final value from applying heuristic in recursion
+ * affordable order of a state that maximizes the sum of its G tables, the fallback of
+ * query_policy when even the first period does not fit the budget; costs O(capacity)
  * @param state
- * @return
+ * @return order quantities
  */
-double TwoProduct::heuristic1_2(const StateMulti &state) {
-    const int a1_star = astar_G[0][state.get_period() - 1];
-    const int a2_star = astar_G[1][state.get_period() - 1];
-    if (state.get_ini_inventory1() > a1_star - 1e-1 and
-        state.get_ini_inventory2() > a2_star - 1e-1) {
-        cache_values_heuristic1[state] = get_action_value_heuristic1(state, {0.0, 0.0});
-        return cache_values_heuristic1[state];
+std::array<double, 2> TwoProduct::g_table_order(const StateMulti &state) const {
+    const int t_index = state.get_period() - 1;
+    const int inventory1 = static_cast<int>(state.get_ini_inventory1());
+    const int inventory2 = static_cast<int>(state.get_ini_inventory2());
+    std::array<double, 2> best_order{};
+    double best_value = std::numeric_limits<double>::lowest();
+    // inventories above the tables order nothing and take the last level
+    for (int y1 = std::min(inventory1, capacity - 1); y1 < capacity; y1++) {
+        const int q1 = std::max(y1 - inventory1, 0);
+        const double cash_left = state.get_ini_cash() - unit_order_costs[0] * q1;
+        if (cash_left < 0)
+            break;
+        const int y2 = std::min(inventory2 + static_cast<int>(cash_left / unit_order_costs[1]),
+                                capacity - 1);
+        const double this_value = cache_valuesG[0][t_index][y1] + cache_valuesG[1][t_index][y2];
+        if (this_value > best_value) {
+            best_value = this_value;
+            best_order = {static_cast<double>(q1),
+                          static_cast<double>(std::max(y2 - inventory2, 0))};
+        }
     }
-    if (state.get_ini_inventory1() > a1_star - 1e-1 and
-        state.get_ini_inventory2() < a2_star - 1e-1) {
-        const double q = std::fmin(a2_star, state.get_ini_cash() / unit_order_costs[1] +
-                                                    state.get_ini_inventory2());
-        cache_values_heuristic1[state] = get_action_value_heuristic1(state, {0.0, q});
-        return cache_values_heuristic1[state];
+    return best_order;
+}
+
+/**
+ * exact recursion up to the horizon period, where the G-table estimate takes over; stops early
+ * when the deadline of the query passes
+ * @param state
+ * @param horizon
+ * @return value without the cash of the state, like recursion
+ */
+double TwoProduct::lookahead(const StateMulti &state, const int horizon) { // NOLINT(*-no-recursion)
+    if (lookahead_expired)
+        return 0.0;
+    if (const auto it = cache_lookahead[horizon].find(state); it != cache_lookahead[horizon].end())
+        return it->second;
+    if (state.get_period() == horizon) {
+        const double value = g_estimate(state) - state.get_ini_cash();
+        cache_lookahead[horizon][state] = value;
+        return value;
     }
-    if (state.get_ini_inventory1() < a1_star - 1e-1 and
-        state.get_ini_inventory2() > a2_star - 1e-1) {
-        const double q = std::fmin(a1_star, state.get_ini_cash() / unit_order_costs[0] +
-                                                    state.get_ini_inventory1());
-        cache_values_heuristic1[state] = get_action_value_heuristic1(state, {q, 0.0});
-        return cache_values_heuristic1[state];
+    if (std::chrono::steady_clock::now() > lookahead_deadline) {
+        lookahead_expired = true;
+        return 0.0;
     }
-    if (state.get_ini_inventory1() < a1_star - 1e-1 and
-        state.get_ini_inventory2() < a2_star - 1e-1) {
-        if (state.get_ini_cash() >
-            unit_order_costs[0] * (a1_star - state.get_ini_inventory1()) +
-                    unit_order_costs[1] * (a2_star - state.get_ini_inventory2())) {
-            cache_values_heuristic1[state] = get_action_value_heuristic1(
-                    state, {static_cast<double>(a1_star), static_cast<double>(a2_star)});
-            return cache_values_heuristic1[state];
+
+    double best_value = std::numeric_limits<double>::lowest();
+    for (const std::array action: feasible_actions(state)) {
+        double this_value = 0;
+        for (const auto demand_and_prob: pmf) {
+            const auto demands = std::array{demand_and_prob[0], demand_and_prob[1]};
+            this_value += demand_and_prob[2] * immediate_value(state, action, demands);
+            if (state.get_period() < T)
+                this_value += demand_and_prob[2] *
+                              lookahead(state_transition(state, action, demands), horizon);
         }
-        if (state.get_period() < T) {
-            const int t_index = state.get_period() - 1;
-            double best_value = std::numeric_limits<double>::lowest();
-            double this_value = 0.0;
-            double best_y1 = 0;
-            double best_y2 = 0;
-            for (int y = static_cast<int>(state.get_ini_inventory1()); y < capacity; y++) {
-                const int y2 =
-                        static_cast<int>(state.get_ini_inventory2() +
-                                         (state.get_ini_cash() -
-                                          unit_order_costs[0] * (y - state.get_ini_inventory1())) /
-                                                 unit_order_costs[1]);
-                if (y2 < 0)
-                    continue;
-                this_value = cache_valuesG[0][t_index][y] + cache_valuesG[1][t_index][y2];
-                if (this_value > best_value) {
-                    best_value = this_value;
-                    best_y1 = y;
-                    best_y2 = y2;
-                }
+        if (lookahead_expired)
+            return 0.0;
+        best_value = std::fmax(best_value, this_value);
+    }
+    cache_lookahead[horizon][state] = best_value;
+    return best_value;
+}
+
+/**
+ * best order quantities for one state within a latency budget. The lookahead deepens one period
+ * at a time and the deepest one finished within the budget gives the answer. When not even the
+ * first period finishes, the answer is the G-table order of g_table_order with depth 0. Values of
+ * the lookahead are kept for later queries. Needs set_pmfs and get_a_stars for the G-table
+ * estimate beyond the lookahead.
+ * @param state
+ * @param time_budget seconds
+ * @param max_depth largest number of periods looked ahead exactly
+ * @return
+ */
+PolicyQuery TwoProduct::query_policy(const StateMulti &state, const double time_budget,
+                                     const int max_depth) {
+    const auto budget_end =
+            std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(time_budget));
+    const int last_depth = std::min(max_depth, T - state.get_period() + 1);
+    if (static_cast<int>(cache_lookahead.size()) < T + 2)
+        cache_lookahead.resize(T + 2);
+
+    const auto [fallback_q1, fallback_q2] = g_table_order(state);
+    PolicyQuery result{fallback_q1, fallback_q2, g_estimate(state), 0, false};
+    for (int depth = 1; depth <= last_depth; depth++) {
+        const int horizon = state.get_period() + depth;
+        lookahead_expired = false;
+        lookahead_deadline = budget_end;
+        double best_q1 = 0.0;
+        double best_q2 = 0.0;
+        double best_value = std::numeric_limits<double>::lowest();
+        for (const std::array action: feasible_actions(state)) {
+            // a depth-1 lookahead never recurses, so the deadline is checked per action as well
+            if (std::chrono::steady_clock::now() > budget_end) {
+                lookahead_expired = true;
+                break;
+            }
+            double this_value = 0;
+            for (const auto demand_and_prob: pmf) {
+                const auto demands = std::array{demand_and_prob[0], demand_and_prob[1]};
+                this_value += demand_and_prob[2] * immediate_value(state, action, demands);
+                if (state.get_period() < T)
+                    this_value += demand_and_prob[2] *
+                                  lookahead(state_transition(state, action, demands), horizon);
+            }
+            if (lookahead_expired)
+                break;
+            if (this_value > best_value) {
+                best_value = this_value;
+                best_q1 = action[0];
+                best_q2 = action[1];
             }
-            // best_value = get_action_value_heuristic1(state, {best_y1, best_y2});
-            double addition = state.get_ini_cash() +
-                              unit_order_costs[0] * state.get_ini_inventory1() +
-                              unit_order_costs[1] * state.get_ini_inventory2();
-            addition *= std::pow(1 + interest_rate, T - t_index);
-            cache_values_heuristic1[state] = best_value + addition;
-            // cache_values_heuristic1[state] = best_value;
-            return cache_values_heuristic1[state];
         }
+        if (lookahead_expired)
+            break;
+        result = {best_q1, best_q2, best_value + state.get_ini_cash(), depth, horizon > T};
+        if (std::chrono::steady_clock::now() > budget_end)
+            break;
     }
-
-    cache_values_heuristic1[state] = get_action_value(state, {0.0, 0.0});
-    return cache_values_heuristic1[state];
+    return result;
 }
 
+std::size_t TwoProduct::num_states_lookahead() const {
+    std::size_t states = 0;
+    for (const auto &memo: cache_lookahead)
+        states += memo.size();
+    return states;
+}
 
 std::array<double, 3> TwoProduct::get_1period_value(const StateMulti &state) const {
     double best_value = std::numeric_limits<double>::lowest();
@@ -373,8 +728,9 @@ double TwoProduct::heuristic2(const StateMulti &state) { // NOLINT
 std::vector<double> TwoProduct::solve(const StateMulti &state) {
     std::vector<double> results(3);
     results[0] = recursion(state) + state.get_ini_cash();
-    results[1] = cache_actions[state][0];
-    results[2] = cache_actions[state][1];
+    const auto action = compact_memo ? cache_compact.get_action(state) : cache_actions[state];
+    results[1] = action[0];
+    results[2] = action[1];
     return results;
 }
 
@@ -394,37 +750,130 @@ void TwoProduct::get_a_stars() {
         cache_valuesG[0][T][i] = (unit_salvage_values[0] - unit_order_costs[0]) * i;
         cache_valuesG[1][T][i] = (unit_salvage_values[1] - unit_order_costs[1]) * i;
     }
+    astar_G[0][T] = 0;
+    astar_G[1][T] = 0;
 
+    prepare_stageG();
+    // the two products are independent, so their stages run on separate threads
+    if (num_threads > 1) {
+        std::thread worker(&TwoProduct::compute_productG, this, 2);
+        compute_productG(1);
+        worker.join();
+    } else {
+        compute_productG(1);
+        compute_productG(2);
+    }
+}
+
+/**
+ * precompute the discount factors and the structure-of-arrays pmf tables used by compute_stageG
+ */
+void TwoProduct::prepare_stageG() {
+    discount_factors.resize(T + 1);
+    for (int t = 0; t <= T; t++)
+        discount_factors[t] = std::pow(1 + interest_rate, T - t);
+
+    for (int index = 0; index < 2; index++) {
+        int max_demand = 0;
+        for (const auto demand_and_prob: pmfs[index])
+            max_demand = std::max(max_demand, static_cast<int>(demand_and_prob[0]));
+        auto &probs = pmfs_probs[index];
+        probs.assign(max_demand + 1, 0.0);
+        for (const auto demand_and_prob: pmfs[index])
+            probs[static_cast<int>(demand_and_prob[0])] += demand_and_prob[1];
+
+        auto &tails = pmfs_tails[index];
+        tails.assign(max_demand + 2, 0.0);
+        for (int d = max_demand; d >= 0; d--)
+            tails[d] = tails[d + 1] + probs[d];
+
+        // E[min(y, D)] = E[min(y - 1, D)] + P(D >= y)
+        auto &expected_min = expected_mins[index];
+        expected_min.assign(capacity, 0.0);
+        for (int y = 1; y < capacity; y++)
+            expected_min[y] = expected_min[y - 1] + tails[std::min(y, max_demand + 1)];
+    }
+}
+
+/**
+ * backward induction of G and a* for one product
+ * @param product_index 1 or 2
+ */
+void TwoProduct::compute_productG(const int product_index) {
+    const int index = product_index - 1;
+    if (g_table_store and
+        g_table_store->load(g_table_key(index), astar_G[index], cache_valuesG[index]))
+        return;
     const int end_y = capacity - 1;
+    // split the y range of a stage only when each thread gets enough work to pay for its start
+    constexpr long min_work_per_thread = 1L << 18;
+    const long stage_work =
+            static_cast<long>(capacity) * static_cast<long>(pmfs_probs[index].size());
+    const int stage_threads = static_cast<int>(std::clamp<long>(
+            stage_work / min_work_per_thread, 1, std::max(1, num_threads / 2)));
+
     for (int t = T - 1; t >= 0; t--) {
-        constexpr int start_y = 0;
-        compute_stageG(t, start_y, end_y, 1);
-        compute_stageG(t, start_y, end_y, 2);
+        if (stage_threads > 1) {
+            std::vector<std::thread> workers;
+            const int chunk = (capacity + stage_threads - 1) / stage_threads;
+            for (int start_y = chunk; start_y <= end_y; start_y += chunk)
+                workers.emplace_back(&TwoProduct::compute_stageG, this, t, start_y,
+                                     std::min(start_y + chunk - 1, end_y), product_index);
+            compute_stageG(t, 0, std::min(chunk - 1, end_y), product_index);
+            for (auto &worker: workers)
+                worker.join();
+        } else {
+            compute_stageG(t, 0, end_y, product_index);
+        }
+
+        // G is flat near its maximum, so take the smallest y that ties with the maximum up to
+        // round-off; this keeps a* independent of the summation order
+        const auto &values = cache_valuesG[index][t];
+        const double best_value = *std::max_element(values.begin(), values.end());
+        const double tolerance = 1e-9 * std::fmax(1.0, std::fabs(best_value));
+        astar_G[index][t] = static_cast<int>(
+                std::find_if(values.begin(), values.end(),
+                             [&](const double value) { return value >= best_value - tolerance; }) -
+                values.begin());
     }
+    if (g_table_store)
+        g_table_store->save(g_table_key(index), astar_G[index], cache_valuesG[index]);
 }
 
+/**
+ * compute G_t(y) for y in [start_y, end_y]; the expectation over demand is accumulated for all y
+ * at once, one demand cell at a time, so that the inner loop is a contiguous multiply-add
+ * @param t
+ * @param start_y
+ * @param end_y
+ * @param product_index 1 or 2
+ */
 void TwoProduct::compute_stageG(const int t, const int start_y, const int end_y,
                                 const int product_index) {
     const int index = product_index - 1;
-    double best_value = std::numeric_limits<double>::lowest();
-    for (int i = start_y; i <= end_y; i++) {
-        double this_value = 0.0;
-        for (auto demand_and_prob: pmfs[index]) {
-            const auto demand = demand_and_prob[0];
-            double this_p_value = 0.0;
-            this_p_value += (prices[index] - unit_order_costs[index]) * std::fmin(i, demand);
-            this_p_value -= interest_rate * unit_order_costs[index] * i;
-            this_p_value *= std::pow(1 + interest_rate, T - t);
-            const int next_y =
-                    static_cast<int>(std::fmax(astar_G[index][t + 1], std::fmax(i - demand, 0.0)));
-            this_p_value += cache_valuesG[index][t + 1][next_y];
-            this_value += demand_and_prob[1] * this_p_value;
-        }
-        cache_valuesG[index][t][i] = this_value;
-        if (this_value > best_value) {
-            best_value = this_value;
-            astar_G[index][t] = i;
-        }
+    const auto &probs = pmfs_probs[index];
+    const auto &tails = pmfs_tails[index];
+    const auto &expected_min = expected_mins[index];
+    const int max_demand = static_cast<int>(probs.size()) - 1;
+    const int a_star_next = astar_G[index][t + 1];
+    const double *next_values = cache_valuesG[index][t + 1].data();
+    double *values = cache_valuesG[index][t].data();
+
+    const double margin = discount_factors[t] * (prices[index] - unit_order_costs[index]);
+    const double holding =
+            discount_factors[t] * interest_rate * unit_order_costs[index] * tails[0];
+    const double floor_value = next_values[a_star_next];
+
+    // demands d >= y - a* lift the next inventory to a*
+    for (int y = start_y; y <= end_y; y++) {
+        const int k = std::clamp(y - a_star_next, 0, max_demand + 1);
+        values[y] = margin * expected_min[y] - holding * y + floor_value * tails[k];
+    }
+    // demands d < y - a* leave y - d for the next stage
+    for (int d = 0; d <= max_demand; d++) {
+        const double p = probs[d];
+        for (int y = std::max(start_y, a_star_next + d + 1); y <= end_y; y++)
+            values[y] += p * next_values[y - d];
     }
 }
 
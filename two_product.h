@@ -9,12 +9,38 @@
 #ifndef TWO_PRODUCT_H
 #define TWO_PRODUCT_H
 
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
+#include "compact_memo.h"
+#include "g_table_store.h"
 #include "state_multi.h"
 #include "state_heuristic2.h"
 
+// answer of a single-state policy query
+struct PolicyQuery {
+    double q1;
+    double q2;
+    double value; // estimated final cash balance
+    int depth; // number of periods looked ahead exactly, 0 for the G-table fallback
+    bool exact; // the lookahead reached the end of the horizon
+};
+
+// compile-time rule of TwoProduct::recursion_engine
+enum class RecursionRule {
+    exact, // search all feasible actions, the recursion memo
+    exact_compact, // same with the compact memo
+    theorem2, // order up to a* by Theorem 2 when it applies, the recursion2 memo
+    g_table // theorem2, plus the G-table value before period T when a* is unaffordable
+};
+
+// order quantities of a state, e.g. from a stationary policy
+using OrderPolicy = std::function<std::array<double, 2>(const StateMulti &)>;
+
 class TwoProduct {
     int T;
     int capacity;
@@ -31,14 +57,68 @@ class TwoProduct {
     std::unordered_map<StateMulti, double> cache_values;
     std::unordered_map<StateMulti, std::array<double, 2>> cache_actions;
 
+    // replaces cache_values and cache_actions in recursion when compact_memo is on
+    bool compact_memo = false;
+    CompactMemo cache_compact;
+
     std::array<std::vector<std::vector<double>>, 2> cache_valuesG;
 
+    // structure-of-arrays views of pmfs used by the G stage, indexed by integer demand
+    std::array<std::vector<double>, 2> pmfs_probs;
+    std::array<std::vector<double>, 2> pmfs_tails; // tails[k] = P(D >= k)
+    std::array<std::vector<double>, 2> expected_mins; // E[min(y, D)] for each y
+    std::vector<double> discount_factors; // (1 + r)^(T - t)
+    int num_threads;
+    std::shared_ptr<const GTableStore> g_table_store; // a* and G tables kept across runs
+
+    [[nodiscard]] GTableKey g_table_key(int index) const;
+    [[nodiscard]] double g_table_value(const StateMulti &state, int t_index) const;
+    [[nodiscard]] std::array<double, 2> g_table_order(const StateMulti &state) const;
+
     std::unordered_map<StateMulti, double>
             cache_value2; // for using a* in dynamic programming
 
     std::unordered_map<StateMulti, double> cache_values_heuristic2;
     std::unordered_map<StateMulti, double> cache_values_heuristic1;
 
+    // fixed-point cash: number of cash units per currency unit, 0 keeps cash as plain double
+    int cash_scale = 0;
+    std::array<long long, 2> price_units{};
+    std::array<long long, 2> order_cost_units{};
+    std::array<long long, 2> salvage_units{};
+
+    [[nodiscard]] long long to_cash_units(double cash) const;
+    [[nodiscard]] long long immediate_value_units(const StateMulti &ini_state,
+                                                  const std::array<double, 2> &actions,
+                                                  const std::array<double, 2> &demands) const;
+    [[nodiscard]] bool reaches(double inventory, int level) const;
+    [[nodiscard]] bool affords(const StateMulti &state, double level1, double level2) const;
+    [[nodiscard]] double max_order_up_to(const StateMulti &state, int product_index) const;
+
+    // values of the bounded lookahead, indexed by the period where the G-table estimate starts;
+    // kept across queries
+    std::vector<std::unordered_map<StateMulti, double>> cache_lookahead;
+    std::chrono::steady_clock::time_point lookahead_deadline;
+    bool lookahead_expired = false;
+
+    double lookahead(const StateMulti &state, int horizon);
+    void clear_memos();
+
+    // one recursion for every RecursionRule; the interest, fixed-point cash and last-period
+    // variants are separate instantiations, so the expectation loop has no mode checks
+    template<RecursionRule rule>
+    double run_recursion(const StateMulti &state);
+    template<RecursionRule rule, bool with_interest, bool fixed_point>
+    double recursion_engine(const StateMulti &state);
+    template<RecursionRule rule, bool with_interest, bool fixed_point>
+    double engine_action_value(const StateMulti &state, const std::array<double, 2> &action);
+    template<bool with_interest, bool fixed_point, bool last_period>
+    double engine_step(const StateMulti &state, const std::array<double, 2> &action,
+                       const std::array<double, 2> &demands, StateMulti &next_state) const;
+
+    double evaluate_policy(const StateMulti &state, const OrderPolicy &policy,
+                           std::unordered_map<StateMulti, double> &values);
+
 public:
     std::array<std::vector<int>, 2> astar_G;
 
@@ -55,27 +135,56 @@ public:
     [[nodiscard]] double immediate_value(const StateMulti &ini_state,
                                          const std::array<double, 2> &actions,
                                          const std::array<double, 2> &demands) const;
-    [[nodiscard]] double get_action_value(const StateMulti &state,
-                                                   const std::array<double, 2> &action);
-    [[nodiscard]] double get_action_value_heuristic1(const StateMulti &state,
-                                                   const std::array<double, 2> &action);
+    void set_pmf(const std::vector<std::array<double, 3>> &new_pmf);
+    std::array<double, 2> policy_action(const StateMulti &state);
+    double evaluate_policy(const StateMulti &state, TwoProduct &policy);
+    double evaluate_policy(const StateMulti &state, const OrderPolicy &policy);
 
     double recursion(const StateMulti &state);
     double recursion2(const StateMulti &state);
     std::vector<double> solve(const StateMulti &state);
 
     void get_a_stars();
+    void prepare_stageG();
+    void compute_productG(int product_index);
     void compute_stageG(int t, int start_y, int end_y, int product_index);
+    void set_num_threads(int n);
+    void set_g_table_store(const std::string &directory);
+    void set_cash_scale(int scale);
+    void set_compact_memo(bool compact, bool delta_encoded = false);
+    [[nodiscard]] double get_compact_max_error() const { return cache_compact.get_max_error(); }
     void set_pmfs(const std::array<double, 2> &means, const std::array<double, 2> &scales,
                   double truncated_quantile);
 
     double heuristic1(const StateMulti &state) const;
+    [[nodiscard]] double g_estimate(const StateMulti &state) const;
+    PolicyQuery query_policy(const StateMulti &state, double time_budget, int max_depth);
     double heuristic1_2(const StateMulti &state);
 
     double heuristic2(const StateMulti &state);
     double heuristic2_2(const StateMulti &state);
 
     std::array<double, 3> get_1period_value(const StateMulti & state) const;
+
+    [[nodiscard]] int get_T() const { return T; }
+    [[nodiscard]] int get_capacity() const { return capacity; }
+    [[nodiscard]] double get_max_I() const { return max_I; }
+    [[nodiscard]] double get_interest_rate() const { return interest_rate; }
+    [[nodiscard]] const std::vector<double> &get_prices() const { return prices; }
+    [[nodiscard]] const std::vector<double> &get_unit_order_costs() const {
+        return unit_order_costs;
+    }
+    [[nodiscard]] const std::vector<std::array<double, 3>> &get_pmf() const { return pmf; }
+
+    // number of states stored in the memo of each recursion
+    [[nodiscard]] std::size_t num_states_recursion() const {
+        return compact_memo ? cache_compact.size() : cache_values.size();
+    }
+    [[nodiscard]] std::size_t num_states_recursion2() const { return cache_value2.size(); }
+    [[nodiscard]] std::size_t num_states_heuristic1() const {
+        return cache_values_heuristic1.size();
+    }
+    [[nodiscard]] std::size_t num_states_lookahead() const;
 };
 
 